@@ -0,0 +1,96 @@
+#include "autolink.h"
+
+#include <sstream>
+#include <unordered_map>
+
+#include <unistd.h>
+
+#include "macho_parser.h"
+#include "parallel.h"
+
+
+static bool isFile(const std::string &path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+// ld prefers text stubs over dylibs, and dylibs over archives, within each
+// directory before moving on to the next one.
+static void findLibrary(const std::string &name, const LinkerSearchPaths &searchPaths, AutolinkLibrary &library) {
+    for (const auto &dir : searchPaths.libraryDirs) {
+        for (auto extension : {".tbd", ".dylib", ".a"}) {
+            auto path = dir + "/lib" + name + extension;
+            if (isFile(path)) {
+                library.path = path;
+                library.kind = extension[1] == 'a' ? AutolinkKind::Static : AutolinkKind::Dylib;
+                return;
+            }
+        }
+    }
+}
+
+static void findFramework(const std::string &name, const LinkerSearchPaths &searchPaths, AutolinkLibrary &library) {
+    for (const auto &dir : searchPaths.frameworkDirs) {
+        auto binary = dir + "/" + name + ".framework/" + name;
+        for (const auto &path : {binary + ".tbd", binary}) {
+            if (isFile(path)) {
+                library.path = path;
+                library.kind = AutolinkKind::Dylib;
+                return;
+            }
+        }
+    }
+}
+
+std::vector<AutolinkLibrary> predictAutolinkLibraries(const std::vector<std::string> &files,
+                                                      const LinkerSearchPaths &searchPaths, unsigned jobs) {
+    // Hints of every object, collected in parallel and merged in input order
+    std::vector<std::vector<std::vector<std::string>>> hints(files.size());
+    parallelFor(files.size(), jobs, [&](size_t i) {
+        std::ostringstream diagnostics;  // anything else in a build directory is not an error
+        for (auto &slice : parseMachO(files[i], diagnostics)) {
+            if (slice.filetype == MH_OBJECT) {
+                hints[i].insert(hints[i].end(), slice.linker_options.begin(), slice.linker_options.end());
+            }
+        }
+    });
+
+    std::vector<AutolinkLibrary> libraries;
+    std::unordered_map<std::string, size_t> indexByOption;
+    for (size_t i = 0; i < files.size(); i++) {
+        for (const auto &hint : hints[i]) {
+            std::string option;
+            for (const auto &argument : hint) {
+                option += (option.empty() ? "" : " ") + argument;
+            }
+            auto inserted = indexByOption.emplace(option, libraries.size());
+            if (inserted.second) {
+                AutolinkLibrary library;
+                library.option = option;
+                if (hint.size() == 1 && hint[0].compare(0, 2, "-l") == 0) {
+                    findLibrary(hint[0].substr(2), searchPaths, library);
+                } else if (hint.size() == 2 && hint[0] == "-framework") {
+                    findFramework(hint[1], searchPaths, library);
+                }
+                libraries.push_back(std::move(library));
+            }
+            auto &objects = libraries[inserted.first->second].objects;
+            // Fat objects carry the same hint once per slice
+            if (objects.empty() || objects.back() != files[i]) {
+                objects.push_back(files[i]);
+            }
+        }
+    }
+    return libraries;
+}
+
+const char *autolinkKindName(AutolinkKind kind) {
+    switch (kind) {
+        case AutolinkKind::Dylib:
+            return "dylib";
+        case AutolinkKind::Static:
+            return "static";
+        case AutolinkKind::NotFound:
+            return "not found";
+    }
+    return "";
+}
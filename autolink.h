@@ -0,0 +1,37 @@
+#ifndef MACDEPENDENCY_AUTOLINK_H
+#define MACDEPENDENCY_AUTOLINK_H
+
+#include <string>
+#include <vector>
+
+
+// Directories ld searches for -l and -framework, starting out with its defaults.
+// Directories given with -L and -F go in front of them.
+struct LinkerSearchPaths {
+    std::vector<std::string> libraryDirs {"/usr/lib", "/usr/local/lib"};
+    std::vector<std::string> frameworkDirs {"/Library/Frameworks", "/System/Library/Frameworks"};
+};
+
+enum class AutolinkKind {
+    Dylib,     // a .dylib or .tbd stub, so the final image will load it
+    Static,    // a .a archive, linked in
+    NotFound,  // ld skips autolink hints it cannot satisfy
+};
+
+// One library the LC_LINKER_OPTION hints of a set of objects ask for.
+struct AutolinkLibrary {
+    std::string option;                // "-lz" or "-framework Foundation"
+    std::string path;                  // file ld would pick, empty if not found
+    AutolinkKind kind = AutolinkKind::NotFound;
+    std::vector<std::string> objects;  // objects with the hint, in input order
+};
+
+// Collects the autolink hints of every MH_OBJECT file among `files` (parsed on
+// up to `jobs` threads) and looks each library up the way ld would, in order
+// of first appearance. Other files are ignored.
+std::vector<AutolinkLibrary> predictAutolinkLibraries(const std::vector<std::string> &files,
+                                                      const LinkerSearchPaths &searchPaths, unsigned jobs);
+
+const char *autolinkKindName(AutolinkKind kind);
+
+#endif // MACDEPENDENCY_AUTOLINK_H
@@ -0,0 +1,85 @@
+#include "bundle_orphans.h"
+
+#include <filesystem>
+#include <sstream>
+#include <unordered_set>
+
+#include "file_walker.h"
+#include "parallel.h"
+
+
+static bool hasFileType(const BundleFile &file, uint32_t filetype);
+static std::string mainExecutable(const std::string &bundle, const std::vector<BundleFile> &files);
+
+
+// IMPLEMENTATION BELOW
+
+static bool hasFileType(const BundleFile &file, uint32_t filetype) {
+    for (const auto &slice : file.slices) {
+        if (slice.filetype == filetype) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string mainExecutable(const std::string &bundle, const std::vector<BundleFile> &files) {
+    auto macOS = std::filesystem::path(bundle) / "Contents" / "MacOS";
+    for (const auto &file : files) {
+        if (hasFileType(file, MH_EXECUTE) && std::filesystem::path(file.path).parent_path() == macOS) {
+            return file.path;
+        }
+    }
+    return {};
+}
+
+std::vector<BundleFile> scanBundle(const std::string &bundle, RecordCache *cache, unsigned jobs) {
+    auto paths = expandPaths({bundle});
+    std::vector<BundleFile> parsed(paths.size());
+    parallelFor(paths.size(), jobs, [&](size_t i) {
+        std::ostringstream diagnostics;  // most files of a bundle are not Mach-O files
+        parsed[i].slices = parseMachOCached(paths[i], cache, diagnostics);
+        parsed[i].path = std::move(paths[i]);
+    });
+
+    std::vector<BundleFile> files;
+    for (auto &file : parsed) {
+        if (!file.slices.empty() && !file.slices.front().text_stub) {
+            files.push_back(std::move(file));
+        }
+    }
+    return files;
+}
+
+OrphanReport findOrphans(const std::string &bundle, const std::vector<BundleFile> &files, DyldResolver &resolver,
+                         const std::string &executablePath) {
+    for (const auto &file : files) {
+        resolver.addParsedFile(file.path, file.slices);
+    }
+    auto mainPath = executablePath.empty() ? mainExecutable(bundle, files) : executablePath;
+
+    OrphanReport report;
+    std::unordered_set<std::string> loaded;
+    for (size_t i = 0; i < files.size(); i++) {
+        bool executable = hasFileType(files[i], MH_EXECUTE);
+        if (!executable && !hasFileType(files[i], MH_BUNDLE)) {
+            continue;
+        }
+        // Executables are the main executable of their own process; plugins are loaded into the app
+        report.roots.push_back(i);
+        for (const auto &closure : resolver.resolveClosures(files[i].path, executable ? "" : mainPath)) {
+            for (const auto &image : closure.images) {
+                loaded.insert(resolver.realPath(image.path));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!loaded.count(resolver.realPath(files[i].path))) {
+            std::error_code error;
+            auto size = std::filesystem::file_size(files[i].path, error);
+            report.orphans.push_back({i, error ? 0 : static_cast<uint64_t>(size)});
+        }
+    }
+    return report;
+}
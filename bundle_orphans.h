@@ -0,0 +1,40 @@
+#ifndef MACDEPENDENCY_BUNDLE_ORPHANS_H
+#define MACDEPENDENCY_BUNDLE_ORPHANS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dyld_resolver.h"
+#include "record_cache.h"
+
+
+// A Mach-O file found in a bundle.
+struct BundleFile {
+    std::string path;
+    std::vector<MachOInfo> slices;
+};
+
+// Walks `bundle` and parses every file below it on `jobs` threads. Files that
+// are neither Mach-O files nor text stubs are left out.
+std::vector<BundleFile> scanBundle(const std::string &bundle, RecordCache *cache, unsigned jobs);
+
+struct OrphanReport {
+    std::vector<size_t> roots;  // indices into the bundle's files, in walk order
+    struct Orphan {
+        size_t file;
+        uint64_t size;          // of the whole file
+    };
+    std::vector<Orphan> orphans;
+};
+
+// Resolves the closures of every executable (the app, helpers and XPC
+// services) and every loadable bundle (plugins) of a scanned bundle, and
+// collects the files that none of them loads. Plugins are resolved with the
+// main executable, the first executable directly in <bundle>/Contents/MacOS,
+// unless `executablePath` names another. The files are handed to the
+// resolver first, so nothing is parsed twice.
+OrphanReport findOrphans(const std::string &bundle, const std::vector<BundleFile> &files, DyldResolver &resolver,
+                         const std::string &executablePath);
+
+#endif // MACDEPENDENCY_BUNDLE_ORPHANS_H
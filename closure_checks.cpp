@@ -0,0 +1,219 @@
+#include "closure_checks.h"
+
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+
+#include "content_hash.h"
+#include "parallel.h"
+#include "symbol_reader.h"
+
+
+bool SliceHashCache::hash(const std::string &path, const MachOInfo &slice, uint64_t &hash) {
+    auto key = path + '\0' + std::to_string(slice.offset);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        Entry entry {};
+        entry.ok = records_ && records_->lookupHash(path, slice.offset, entry.hash);
+        if (!entry.ok) {
+            entry.ok = slice.text_stub ? hashFile(path, entry.hash)
+                                       : hashFileRange(path, slice.offset, slice.size, entry.hash);
+            if (entry.ok && records_) {
+                records_->storeHash(path, slice.offset, entry.hash);
+            }
+        }
+        it = entries_.emplace(std::move(key), entry).first;
+    }
+    hash = it->second.hash;
+    return it->second.ok;
+}
+
+std::vector<InstallNameCollision> findInstallNameCollisions(const Closure &closure, SliceHashCache &hashes) {
+    std::unordered_map<std::string, std::vector<size_t>> byInstallName;
+    for (size_t i = 0; i < closure.images.size(); i++) {
+        const auto &id = closure.images[i].info.dylib_id;
+        if (!id.empty()) {
+            byInstallName[id].push_back(i);
+        }
+    }
+
+    std::vector<InstallNameCollision> collisions;
+    for (auto &group : byInstallName) {
+        if (group.second.size() < 2) {
+            continue;
+        }
+        InstallNameCollision collision;
+        collision.installName = group.first;
+        collision.images = std::move(group.second);
+        // Unreadable images count as different from everything else.
+        bool differs = false;
+        for (auto index : collision.images) {
+            const auto &image = closure.images[index];
+            uint64_t hash = 0;
+            bool readable = hashes.hash(image.path, image.info, hash);
+            if (!readable) {
+                differs = true;
+            } else if (!collision.hashes.empty() && hash != collision.hashes.front()) {
+                differs = true;
+            }
+            collision.hashes.push_back(hash);
+            collision.readable.push_back(readable);
+        }
+        if (differs) {
+            collisions.push_back(std::move(collision));
+        }
+    }
+
+    // Report in load order of the first image, not hash table order
+    std::sort(collisions.begin(), collisions.end(), [](const auto &a, const auto &b) {
+        return a.images.front() < b.images.front();
+    });
+    return collisions;
+}
+
+std::vector<DuplicateSymbol> findDuplicateSymbols(const Closure &closure, unsigned jobs,
+                                                  std::vector<size_t> &unreadable) {
+    const size_t imageCount = closure.images.size();
+    const size_t partitionCount = std::max(jobs, 1u) * 4;
+
+    // Build side: every image's symbols, bucketed by hash into partitions
+    std::vector<std::vector<std::string>> symbols(imageCount);
+    std::vector<std::vector<std::vector<uint32_t>>> partitions(imageCount);
+    std::vector<char> readable(imageCount, 0);
+    parallelFor(imageCount, jobs, [&](size_t image) {
+        const auto &entry = closure.images[image];
+        readable[image] = readExportedSymbols(entry.path, entry.info, symbols[image]);
+        partitions[image].resize(partitionCount);
+        for (uint32_t i = 0; i < symbols[image].size(); i++) {
+            const auto &name = symbols[image][i];
+            partitions[image][hashBytes(name.data(), name.size()) % partitionCount].push_back(i);
+        }
+    });
+    for (size_t image = 0; image < imageCount; image++) {
+        if (!readable[image]) {
+            unreadable.push_back(image);
+        }
+    }
+
+    // Probe side: each partition is independent, visit images in load order
+    // so the first definition seen is the one dyld would bind to.
+    std::vector<std::vector<DuplicateSymbol>> duplicates(partitionCount);
+    parallelFor(partitionCount, jobs, [&](size_t partition) {
+        struct FirstDefinition {
+            size_t image;
+            size_t duplicate;  // index into duplicates[partition], or SIZE_MAX
+        };
+        std::unordered_map<std::string_view, FirstDefinition> seen;
+        auto &found = duplicates[partition];
+        for (size_t image = 0; image < imageCount; image++) {
+            for (auto i : partitions[image][partition]) {
+                std::string_view name = symbols[image][i];
+                auto inserted = seen.emplace(name, FirstDefinition {image, SIZE_MAX});
+                auto &first = inserted.first->second;
+                if (inserted.second || first.image == image) {
+                    continue;
+                }
+                if (first.duplicate == SIZE_MAX) {
+                    first.duplicate = found.size();
+                    found.push_back({std::string(name), {first.image}});
+                }
+                auto &duplicate = found[first.duplicate];
+                if (duplicate.images.back() != image) {
+                    duplicate.images.push_back(image);
+                }
+            }
+        }
+    });
+
+    std::vector<DuplicateSymbol> result;
+    for (auto &found : duplicates) {
+        std::move(found.begin(), found.end(), std::back_inserter(result));
+    }
+    std::sort(result.begin(), result.end(), [](const DuplicateSymbol &a, const DuplicateSymbol &b) {
+        return a.images.front() != b.images.front() ? a.images.front() < b.images.front() : a.name < b.name;
+    });
+    return result;
+}
+
+Footprint &Footprint::operator+=(const Footprint &other) {
+    images += other.images;
+    cleanVmSize += other.cleanVmSize;
+    cleanFileSize += other.cleanFileSize;
+    dirtyVmSize += other.dirtyVmSize;
+    dirtyFileSize += other.dirtyFileSize;
+    dirtyPages += other.dirtyPages;
+    return *this;
+}
+
+const Footprint &FootprintCache::footprint(const std::string &path, const MachOInfo &slice) {
+    auto key = path + '\0' + std::to_string(slice.offset);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        return it->second;
+    }
+
+    Footprint footprint;
+    footprint.images = 1;
+    uint64_t pageSize = slice.cputype == CPU_TYPE_ARM64 ? 16384 : 4096;
+    for (const auto &segment : slice.segments) {
+        if (segment.maxprot == VM_PROT_NONE) {
+            continue;
+        }
+        if (segment.initprot & VM_PROT_WRITE) {
+            footprint.dirtyVmSize += segment.vmsize;
+            footprint.dirtyFileSize += segment.filesize;
+            footprint.dirtyPages += (segment.vmsize + pageSize - 1) / pageSize;
+        } else {
+            footprint.cleanVmSize += segment.vmsize;
+            footprint.cleanFileSize += segment.filesize;
+        }
+    }
+    return entries_.emplace(std::move(key), footprint).first->second;
+}
+
+ClosureFootprint closureFootprint(const Closure &closure, FootprintCache &footprints) {
+    ClosureFootprint result;
+    for (const auto &image : closure.images) {
+        // By the name it was loaded by, since the path may point into a sysroot
+        const auto &name = image.installName;
+        bool system = name.compare(0, 8, "/System/") == 0 || name.compare(0, 9, "/usr/lib/") == 0;
+        (system ? result.system : result.bundled) += footprints.footprint(image.path, image.info);
+    }
+    return result;
+}
+
+// Every field is length-prefixed or fixed-size, so no two closures feed the same bytes
+Sha256Digest closureFingerprint(const Closure &closure, SliceHashCache &hashes, std::vector<size_t> &unreadable) {
+    Sha256 sha;
+    auto add = [&](uint64_t value) {
+        sha.update(&value, sizeof(value));
+    };
+    auto addString = [&](const std::string &value) {
+        add(value.size());
+        sha.update(value.data(), value.size());
+    };
+
+    addString("closure-fingerprint-1");
+    addString(closure.arch);
+    add(closure.images.size());
+    for (size_t i = 0; i < closure.images.size(); i++) {
+        const auto &image = closure.images[i];
+        uint64_t hash = 0;
+        bool ok = hashes.hash(image.path, image.info, hash);
+        if (!ok) {
+            unreadable.push_back(i);
+        }
+        addString(image.path);
+        addString(image.installName);
+        add(ok);
+        add(hash);
+    }
+    add(closure.edges.size());
+    for (const auto &edge : closure.edges) {
+        add(edge.from);
+        add(edge.to);
+        addString(edge.reference.name);
+        add(edge.reference.command);
+    }
+    return sha.finish();
+}
@@ -0,0 +1,97 @@
+#ifndef MACDEPENDENCY_CLOSURE_CHECKS_H
+#define MACDEPENDENCY_CLOSURE_CHECKS_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dyld_resolver.h"
+#include "sha256.h"
+
+
+// Content hashes of slices, computed on first use and shared between closures.
+// With a record cache, hashes of earlier runs are used while their files are
+// unchanged, and new ones are kept for later runs.
+class SliceHashCache {
+public:
+    explicit SliceHashCache(RecordCache *records = nullptr) : records_(records) {}
+
+    // Returns false if the slice could not be read.
+    bool hash(const std::string &path, const MachOInfo &slice, uint64_t &hash);
+
+private:
+    struct Entry {
+        bool ok;
+        uint64_t hash;
+    };
+    RecordCache *records_;
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+// Images of one closure that share an LC_ID_DYLIB but differ in content.
+struct InstallNameCollision {
+    std::string installName;
+    std::vector<size_t> images;    // closure image indices in load order, images[0] is what dyld binds to
+    std::vector<uint64_t> hashes;  // per image, valid where readable
+    std::vector<bool> readable;    // per image, false if it could not be read
+};
+
+// Groups the closure's images by install name and hashes only the groups with
+// more than one image, so a clean closure costs no I/O at all.
+std::vector<InstallNameCollision> findInstallNameCollisions(const Closure &closure, SliceHashCache &hashes);
+
+// An exported symbol defined by more than one image of a closure.
+struct DuplicateSymbol {
+    std::string name;
+    std::vector<size_t> images;  // closure image indices in load order, images[0] wins a flat-namespace lookup
+};
+
+// Reads the exports of every image on `jobs` threads and partitions them by
+// hash, then joins each partition on its own thread. Images whose symbols
+// could not be read are added to `unreadable`.
+std::vector<DuplicateSymbol> findDuplicateSymbols(const Closure &closure, unsigned jobs,
+                                                  std::vector<size_t> &unreadable);
+
+// Mapped memory of images. Writable segments are dirty: their pages get
+// written by fixups or the program. Segments that map nothing accessible,
+// such as __PAGEZERO, are left out.
+struct Footprint {
+    size_t images = 0;
+    uint64_t cleanVmSize = 0;
+    uint64_t cleanFileSize = 0;
+    uint64_t dirtyVmSize = 0;
+    uint64_t dirtyFileSize = 0;
+    uint64_t dirtyPages = 0;  // 16 KB pages on arm64, 4 KB pages otherwise
+
+    Footprint &operator+=(const Footprint &other);
+};
+
+// Footprint of a closure, split by where its images come from.
+struct ClosureFootprint {
+    Footprint bundled;
+    Footprint system;  // installed under /System or /usr/lib
+};
+
+// Footprints of slices, computed on first use and shared between closures, so
+// that the closures of many variants of an app add up their common images for
+// free. The segments come with the parse results, which the record cache
+// keeps across runs.
+class FootprintCache {
+public:
+    const Footprint &footprint(const std::string &path, const MachOInfo &slice);
+
+private:
+    std::unordered_map<std::string, Footprint> entries_;
+};
+
+ClosureFootprint closureFootprint(const Closure &closure, FootprintCache &footprints);
+
+// SHA-256 over a closure in load order: the architecture, each image's path,
+// install name and content hash, and each edge's endpoints, install name and
+// load command. Anything that changes what the root loads, or how, changes
+// it. Images that could not be hashed are added to `unreadable` and enter as
+// unreadable, so the result is still stable.
+Sha256Digest closureFingerprint(const Closure &closure, SliceHashCache &hashes, std::vector<size_t> &unreadable);
+
+#endif // MACDEPENDENCY_CLOSURE_CHECKS_H
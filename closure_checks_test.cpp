@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "closure_checks.h"
+#include "text_stub.h"
+
+static constexpr const char *kStubHead = "--- !tapi-tbd-v3\n"
+                                         "archs:           [ x86_64 ]\n"
+                                         "platform:        macosx\n"
+                                         "install-name:    /usr/lib/libfoo.dylib\n"
+                                         "exports:\n"
+                                         "  - archs:           [ x86_64 ]\n";
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "failed: " << what << '\n';
+        failures++;
+    }
+}
+
+static ClosureImage stubImage(const std::string &path, const char *symbol) {
+    std::ofstream(path) << kStubHead << "    symbols:         [ " << symbol << " ]\n...\n";
+    auto infos = parseTextStub(path, std::cerr);
+    ClosureImage image;
+    image.path = path;
+    image.installName = "/usr/lib/libfoo.dylib";
+    if (!infos.empty()) {
+        image.info = infos.front();
+    }
+    return image;
+}
+
+// Text stubs with one install name are collisions when their contents differ,
+// like the dylibs they stand for.
+int main() {
+    char dir[] = "/tmp/closure_checks_test.XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cout << "failed: cannot create a temporary directory\n";
+        return 1;
+    }
+    std::string root = dir;
+
+    Closure closure;
+    closure.arch = "x86_64";
+    closure.images.push_back(ClosureImage {root + "/app", "", MachOInfo {}});
+    closure.images.push_back(stubImage(root + "/a.tbd", "_one"));
+    closure.images.push_back(stubImage(root + "/b.tbd", "_one"));
+
+    SliceHashCache hashes;
+    expect(findInstallNameCollisions(closure, hashes).empty(), "identical stubs are no collision");
+
+    closure.images.push_back(stubImage(root + "/c.tbd", "_two"));
+    SliceHashCache moreHashes;
+    auto collisions = findInstallNameCollisions(closure, moreHashes);
+    expect(collisions.size() == 1, "differing stubs are a collision");
+    if (collisions.size() == 1) {
+        const auto &collision = collisions.front();
+        expect(collision.installName == "/usr/lib/libfoo.dylib", "collision has the stubs' install name");
+        expect(collision.images.size() == 3, "collision lists every stub");
+        expect(collision.hashes.size() == 3 && collision.hashes[0] == collision.hashes[1]
+                   && collision.hashes[0] != collision.hashes[2],
+               "stubs are hashed by content");
+    }
+
+    for (const char *name : {"/a.tbd", "/b.tbd", "/c.tbd"}) {
+        unlink((root + name).c_str());
+    }
+    rmdir(dir);
+    std::cout << (failures == 0 ? "ok" : "failed") << '\n';
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+#include "code_signer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libkern/OSByteOrder.h>
+#include <mach-o/fat.h>
+#include <mach-o/loader.h>
+
+#include "fat_tools.h"
+#include "file_copy.h"
+#include "macho_parser.h"
+#include "parallel.h"
+#include "sha256.h"
+
+
+// Blob layout from xnu's osfmk/kern/cs_blobs.h. Everything in a signature is big-endian.
+static constexpr uint32_t kEmbeddedSignatureMagic = 0xfade0cc0;
+static constexpr uint32_t kCodeDirectoryMagic = 0xfade0c02;
+static constexpr uint32_t kRequirementsMagic = 0xfade0c01;
+static constexpr uint32_t kBlobWrapperMagic = 0xfade0b01;
+static constexpr uint32_t kCodeDirectorySlot = 0;
+static constexpr uint32_t kRequirementsSlot = 2;
+static constexpr uint32_t kSignatureSlot = 0x10000;
+static constexpr uint32_t kCodeDirectoryVersion = 0x20400;  // the first one with exec segment fields
+static constexpr uint32_t kCodeDirectorySize = 88;          // header of that version
+static constexpr uint32_t kAdhocFlag = 0x2;
+static constexpr uint64_t kExecSegMainBinary = 0x1;
+static constexpr uint8_t kHashTypeSha256 = 2;
+static constexpr uint32_t kSpecialSlots = 2;                // requirements (-2) and Info.plist (-1)
+static constexpr uint32_t kPageShift = 12;
+static constexpr uint64_t kPageSize = 1 << kPageShift;
+static constexpr size_t kPagesPerTask = 64;
+
+template <bool is64Bit>
+static bool signSlice(std::vector<uint8_t> &slice, const MachOInfo &info, const std::string &identifier,
+                      unsigned jobs, std::string &error);
+static void appendBig32(std::vector<uint8_t> &blob, uint32_t value);
+static void appendBig64(std::vector<uint8_t> &blob, uint64_t value);
+
+
+// IMPLEMENTATION BELOW
+
+bool adhocSignFile(const std::string &input, const std::string &output, const std::string &identifier,
+                   unsigned jobs, std::string &error) {
+    std::ostringstream diagnostics;
+    auto slices = parseMachO(input, diagnostics);
+    if (slices.empty()) {
+        error = "not a Mach-O file";
+        return false;
+    }
+    int in = open(input.c_str(), O_RDONLY);
+    struct stat st {};
+    if (in < 0 || fstat(in, &st) != 0) {
+        error = std::strerror(errno);
+        if (in >= 0) {
+            close(in);
+        }
+        return false;
+    }
+
+    // Slices of a universal binary never start at offset 0. The parser leaves
+    // out slices it cannot name, and rewriting the file would drop them.
+    bool universal = slices.front().offset != 0;
+    if (universal) {
+        struct fat_header fh {};
+        if (!readAt(in, &fh, sizeof(fh), 0) || OSSwapBigToHostInt32(fh.nfat_arch) != slices.size()) {
+            error = "universal binary with slices of unknown architectures";
+            close(in);
+            return false;
+        }
+    }
+
+    auto name = identifier;
+    if (name.empty()) {
+        auto slash = input.rfind('/');
+        name = slash == std::string::npos ? input : input.substr(slash + 1);
+    }
+    std::vector<std::vector<uint8_t>> signedSlices;
+    for (const auto &info : slices) {
+        std::vector<uint8_t> bytes(static_cast<size_t>(info.size));
+        if (!readAt(in, bytes.data(), bytes.size(), info.offset)) {
+            error = info.arch + " slice is truncated";
+            close(in);
+            return false;
+        }
+        bool ok = info.is_64_bit ? signSlice<true>(bytes, info, name, jobs, error)
+                                 : signSlice<false>(bytes, info, name, jobs, error);
+        if (!ok) {
+            error = info.arch + ": " + error;
+            close(in);
+            return false;
+        }
+        signedSlices.push_back(std::move(bytes));
+    }
+    close(in);
+
+    // Slices change size, so a universal binary is laid out again in its original order.
+    std::vector<FatSlice> layout;
+    std::vector<char> header;
+    uint64_t end = signedSlices.front().size();
+    if (universal) {
+        for (size_t i = 0; i < slices.size(); i++) {
+            layout.push_back({slices[i].cputype, slices[i].cpusubtype, signedSlices[i].size(),
+                              sliceAlignment(slices[i].cputype)});
+        }
+        header = layoutFatFile(layout, end);
+    }
+
+    AtomicFile out(output.empty() ? input : output, st.st_mode & 07777);
+    bool ok = out.fd() >= 0 && ftruncate(out.fd(), static_cast<off_t>(end)) == 0
+              && writeAt(out.fd(), header.data(), header.size(), 0);
+    for (size_t i = 0; ok && i < signedSlices.size(); i++) {
+        uint64_t offset = universal ? layout[i].offset : 0;
+        ok = writeAt(out.fd(), signedSlices[i].data(), signedSlices[i].size(), offset);
+    }
+    ok = ok && out.commit();
+    if (!ok) {
+        error = std::strerror(errno);
+    }
+    return ok;
+}
+
+template <bool is64Bit>
+static bool signSlice(std::vector<uint8_t> &slice, const MachOInfo &info, const std::string &identifier,
+                      unsigned jobs, std::string &error) {
+    using MachHeaderType = typename std::conditional<is64Bit, struct mach_header_64, struct mach_header>::type;
+    using SegmentCommandType = typename std::conditional<is64Bit, struct segment_command_64,
+                                                         struct segment_command>::type;
+    constexpr uint32_t kSegmentCommand = is64Bit ? LC_SEGMENT_64 : LC_SEGMENT;
+
+    MachHeaderType mh;
+    if (slice.size() < sizeof(mh)) {
+        error = "truncated header";
+        return false;
+    }
+    std::memcpy(&mh, slice.data(), sizeof(mh));
+    if (sizeof(mh) + uint64_t(mh.sizeofcmds) > slice.size()) {
+        error = "truncated load commands";
+        return false;
+    }
+
+    // Offsets of the commands to update, 0 if absent
+    size_t signaturePos = 0;
+    size_t linkeditPos = 0;
+    SegmentCommandType text {};
+    size_t pos = sizeof(mh);
+    size_t commandsEnd = sizeof(mh) + mh.sizeofcmds;
+    for (uint32_t i = 0; i < mh.ncmds; i++) {
+        struct load_command lc;
+        if (pos + sizeof(lc) > commandsEnd) {
+            error = "truncated load commands";
+            return false;
+        }
+        std::memcpy(&lc, slice.data() + pos, sizeof(lc));
+        if (lc.cmdsize < sizeof(lc) || pos + lc.cmdsize > commandsEnd) {
+            error = "malformed load command";
+            return false;
+        }
+        if (lc.cmd == LC_CODE_SIGNATURE && lc.cmdsize >= sizeof(struct linkedit_data_command)) {
+            signaturePos = pos;
+        } else if (lc.cmd == kSegmentCommand && lc.cmdsize >= sizeof(SegmentCommandType)) {
+            SegmentCommandType segment;
+            std::memcpy(&segment, slice.data() + pos, sizeof(segment));
+            if (std::strncmp(segment.segname, SEG_LINKEDIT, sizeof(segment.segname)) == 0) {
+                linkeditPos = pos;
+            } else if (std::strncmp(segment.segname, SEG_TEXT, sizeof(segment.segname)) == 0) {
+                text = segment;
+            }
+        }
+        pos += lc.cmdsize;
+    }
+    if (!linkeditPos) {
+        error = "no __LINKEDIT segment";
+        return false;
+    }
+    SegmentCommandType linkedit;
+    std::memcpy(&linkedit, slice.data() + linkeditPos, sizeof(linkedit));
+    uint64_t linkeditEnd = uint64_t(linkedit.fileoff) + linkedit.filesize;
+    if (linkeditEnd > slice.size()) {
+        error = "__LINKEDIT extends past the end of the slice";
+        return false;
+    }
+
+    // Everything in front of the signature is hashed; the old signature, if
+    // any, is dropped and the new one takes its place.
+    struct linkedit_data_command signature {};
+    uint64_t codeLimit;
+    if (signaturePos) {
+        std::memcpy(&signature, slice.data() + signaturePos, sizeof(signature));
+        codeLimit = signature.dataoff;
+        if (codeLimit < linkedit.fileoff || codeLimit > linkeditEnd) {
+            error = "existing signature is outside __LINKEDIT";
+            return false;
+        }
+    } else {
+        if (headerPadding(info) < sizeof(signature)) {
+            error = "no room in the header padding for LC_CODE_SIGNATURE";
+            return false;
+        }
+        signaturePos = commandsEnd;
+        signature.cmd = LC_CODE_SIGNATURE;
+        signature.cmdsize = sizeof(signature);
+        mh.ncmds++;
+        mh.sizeofcmds += sizeof(signature);
+        std::memcpy(slice.data(), &mh, sizeof(mh));
+        codeLimit = (linkeditEnd + 15) & ~uint64_t(15);
+    }
+    if (codeLimit > UINT32_MAX) {
+        error = "slice is too large to sign";
+        return false;
+    }
+
+    auto codeSlots = static_cast<uint32_t>((codeLimit + kPageSize - 1) / kPageSize);
+    auto identOffset = kCodeDirectorySize;
+    auto hashOffset = identOffset + static_cast<uint32_t>(identifier.size() + 1) + kSpecialSlots * 32;
+    uint32_t codeDirectoryLength = hashOffset + codeSlots * 32;
+    uint32_t superBlobHeaderLength = 12 + 3 * 8;
+    uint32_t requirementsLength = 12;
+    uint32_t wrapperLength = 8;
+    uint32_t blobLength = superBlobHeaderLength + codeDirectoryLength + requirementsLength + wrapperLength;
+    uint32_t signatureSize = (blobLength + 15) & ~uint32_t(15);
+
+    // The load commands are part of the first page, so they get their final
+    // values before anything is hashed.
+    signature.dataoff = static_cast<uint32_t>(codeLimit);
+    signature.datasize = signatureSize;
+    std::memcpy(slice.data() + signaturePos, &signature, sizeof(signature));
+    uint64_t segmentPage = uint64_t(1) << sliceAlignment(info.cputype);
+    linkedit.filesize = codeLimit + signatureSize - linkedit.fileoff;
+    linkedit.vmsize = std::max<uint64_t>(linkedit.vmsize, (linkedit.filesize + segmentPage - 1) & ~(segmentPage - 1));
+    std::memcpy(slice.data() + linkeditPos, &linkedit, sizeof(linkedit));
+    slice.resize(static_cast<size_t>(codeLimit));  // zero-fills up to the aligned start
+
+    std::vector<uint8_t> requirements;
+    appendBig32(requirements, kRequirementsMagic);
+    appendBig32(requirements, requirementsLength);
+    appendBig32(requirements, 0);  // no requirements
+
+    std::vector<uint8_t> blob;
+    blob.reserve(signatureSize);
+    appendBig32(blob, kEmbeddedSignatureMagic);
+    appendBig32(blob, blobLength);
+    appendBig32(blob, 3);
+    appendBig32(blob, kCodeDirectorySlot);
+    appendBig32(blob, superBlobHeaderLength);
+    appendBig32(blob, kRequirementsSlot);
+    appendBig32(blob, superBlobHeaderLength + codeDirectoryLength);
+    appendBig32(blob, kSignatureSlot);
+    appendBig32(blob, superBlobHeaderLength + codeDirectoryLength + requirementsLength);
+
+    appendBig32(blob, kCodeDirectoryMagic);
+    appendBig32(blob, codeDirectoryLength);
+    appendBig32(blob, kCodeDirectoryVersion);
+    appendBig32(blob, kAdhocFlag);
+    appendBig32(blob, hashOffset);
+    appendBig32(blob, identOffset);
+    appendBig32(blob, kSpecialSlots);
+    appendBig32(blob, codeSlots);
+    appendBig32(blob, static_cast<uint32_t>(codeLimit));
+    blob.push_back(32);  // hashSize
+    blob.push_back(kHashTypeSha256);
+    blob.push_back(0);   // platform
+    blob.push_back(kPageShift);
+    appendBig32(blob, 0);  // spare2
+    appendBig32(blob, 0);  // scatterOffset
+    appendBig32(blob, 0);  // teamOffset
+    appendBig32(blob, 0);  // spare3
+    appendBig64(blob, 0);  // codeLimit64
+    appendBig64(blob, text.fileoff);
+    appendBig64(blob, text.filesize);
+    appendBig64(blob, info.filetype == MH_EXECUTE ? kExecSegMainBinary : 0);
+    blob.insert(blob.end(), identifier.begin(), identifier.end());
+    blob.push_back(0);
+
+    auto requirementsHash = Sha256::hash(requirements.data(), requirements.size());
+    blob.insert(blob.end(), requirementsHash.begin(), requirementsHash.end());  // slot -2
+    blob.insert(blob.end(), 32, 0);                                            // slot -1, no Info.plist
+
+    // Pages are independent, so runs of them are hashed on all threads
+    // straight into their slots.
+    size_t hashes = blob.size();
+    blob.resize(hashes + size_t(codeSlots) * 32);
+    size_t tasks = (codeSlots + kPagesPerTask - 1) / kPagesPerTask;
+    parallelFor(tasks, jobs, [&](size_t task) {
+        size_t first = task * kPagesPerTask;
+        size_t last = std::min<size_t>(first + kPagesPerTask, codeSlots);
+        for (size_t page = first; page < last; page++) {
+            uint64_t start = page * kPageSize;
+            auto length = static_cast<size_t>(std::min(kPageSize, codeLimit - start));
+            auto digest = Sha256::hash(slice.data() + start, length);
+            std::memcpy(blob.data() + hashes + page * 32, digest.data(), digest.size());
+        }
+    });
+
+    blob.insert(blob.end(), requirements.begin(), requirements.end());
+    appendBig32(blob, kBlobWrapperMagic);  // empty CMS signature, as codesign writes for ad-hoc
+    appendBig32(blob, wrapperLength);
+    blob.resize(signatureSize);
+
+    slice.insert(slice.end(), blob.begin(), blob.end());
+    return true;
+}
+
+static void appendBig32(std::vector<uint8_t> &blob, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        blob.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static void appendBig64(std::vector<uint8_t> &blob, uint64_t value) {
+    appendBig32(blob, static_cast<uint32_t>(value >> 32));
+    appendBig32(blob, static_cast<uint32_t>(value));
+}
@@ -0,0 +1,19 @@
+#ifndef MACDEPENDENCY_CODE_SIGNER_H
+#define MACDEPENDENCY_CODE_SIGNER_H
+
+#include <string>
+
+
+// Replaces the code signature of every slice of a Mach-O file with an ad-hoc
+// one, like codesign -s - does. Rewriting load commands invalidates the page
+// hashes of the old signature, and arm64 macOS refuses to run unsigned code.
+//
+// Slices without LC_CODE_SIGNATURE get one if the header padding has room for
+// it. The signature goes at the end of __LINKEDIT, the page hashes are
+// computed on up to `jobs` threads, and the result is renamed over `input`
+// itself when `output` is empty. An empty `identifier` defaults to the file
+// name. Returns false with `error` set on failure.
+bool adhocSignFile(const std::string &input, const std::string &output, const std::string &identifier,
+                   unsigned jobs, std::string &error);
+
+#endif // MACDEPENDENCY_CODE_SIGNER_H
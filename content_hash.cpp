@@ -0,0 +1,141 @@
+#include "content_hash.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "simd_kernels.h"
+
+
+static constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+static constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+static constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+static constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+static constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char *p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t round64(uint64_t accumulator, uint64_t input) {
+    accumulator += input * kPrime2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * kPrime1;
+}
+
+static inline uint64_t mergeRound(uint64_t hash, uint64_t accumulator) {
+    hash ^= round64(0, accumulator);
+    return hash * kPrime1 + kPrime4;
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+    auto p = static_cast<const unsigned char *>(data);
+    auto end = p + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        uint64_t lanes[4] = {seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1};
+        size_t stripes = size / 32;
+        simdKernels().hashStripes(lanes, p, stripes);
+        p += stripes * 32;
+        uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    } else {
+        hash = seed + kPrime5;
+    }
+    hash += size;
+
+    for (; p + 8 <= end; p += 8) {
+        hash ^= round64(0, read64(p));
+        hash = rotateLeft(hash, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+        hash ^= read32(p) * kPrime1;
+        hash = rotateLeft(hash, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= *p * kPrime5;
+        hash = rotateLeft(hash, 11) * kPrime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Hashes a range already checked against the file's size. Does not close `fd`.
+static bool hashOpenRange(int fd, uint64_t offset, uint64_t size, uint64_t &hash) {
+    if (size == 0) {
+        hash = hashBytes(nullptr, 0);
+        return true;
+    }
+
+    // mmap needs a page-aligned offset
+    auto pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    auto mapOffset = offset & ~(pageSize - 1);
+    auto mapSize = static_cast<size_t>(size + (offset - mapOffset));
+    void *mapped = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(mapOffset));
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    madvise(mapped, mapSize, MADV_SEQUENTIAL);
+    hash = hashBytes(static_cast<const char *>(mapped) + (offset - mapOffset), static_cast<size_t>(size));
+    munmap(mapped, mapSize);
+    return true;
+}
+
+bool hashFileRange(const std::string &path, uint64_t offset, uint64_t size, uint64_t &hash) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st {};
+    bool ok = fstat(fd, &st) == 0 && offset <= static_cast<uint64_t>(st.st_size)
+              && size <= static_cast<uint64_t>(st.st_size) - offset && hashOpenRange(fd, offset, size, hash);
+    close(fd);
+    return ok;
+}
+
+bool hashFile(const std::string &path, uint64_t &hash) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st {};
+    bool ok = fstat(fd, &st) == 0 && hashOpenRange(fd, 0, static_cast<uint64_t>(st.st_size), hash);
+    close(fd);
+    return ok;
+}
+
+std::string hashToString(uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        result[i] = digits[hash & 0xf];
+        hash >>= 4;
+    }
+    return result;
+}
@@ -0,0 +1,23 @@
+#ifndef MACDEPENDENCY_CONTENT_HASH_H
+#define MACDEPENDENCY_CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// 64-bit XXH64 of a byte range. Not cryptographic; used to tell whether two
+// files or slices have the same content.
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0);
+
+// Hashes `size` bytes of a file starting at `offset`.
+// Returns false if the file cannot be read or is shorter than that.
+bool hashFileRange(const std::string &path, uint64_t offset, uint64_t size, uint64_t &hash);
+
+// Hashes the whole file, for text stubs, which have no slices to hash.
+bool hashFile(const std::string &path, uint64_t &hash);
+
+// Fixed-width lowercase hex, as printed in reports.
+std::string hashToString(uint64_t hash);
+
+#endif // MACDEPENDENCY_CONTENT_HASH_H
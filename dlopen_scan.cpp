@@ -0,0 +1,116 @@
+#include "dlopen_scan.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_set>
+
+#include "file_reader.h"
+#include "simd_kernels.h"
+
+
+// What a literal has to end in, or for frameworks contain. Each one is looked
+// for with the vector search across the whole section; the literal around a
+// hit is then found by walking to the NULs on either side.
+struct PathMarker {
+    std::string_view text;
+    bool atEnd;  // the literal must end right after the marker
+};
+static constexpr PathMarker kPathMarkers[] = {
+    {".dylib", true},
+    {".so", true},
+    {".bundle", true},
+    {".framework/", false},
+};
+
+static void scanSection(const char *data, size_t size, std::vector<std::pair<size_t, std::string_view>> &hits);
+static bool isLiteralByte(char byte);
+
+
+// IMPLEMENTATION BELOW
+
+static bool isLiteralByte(char byte) {
+    auto value = static_cast<unsigned char>(byte);
+    return value >= 0x20 && value != 0x7f;
+}
+
+// Records (offset, literal) for every marker hit in one section.
+static void scanSection(const char *data, size_t size, std::vector<std::pair<size_t, std::string_view>> &hits) {
+    const auto &kernels = simdKernels();
+    for (const auto &marker : kPathMarkers) {
+        size_t from = 0;
+        while (from < size) {
+            const char *hit = kernels.findBytes(data + from, size - from, marker.text.data(), marker.text.size());
+            if (!hit) {
+                break;
+            }
+            size_t start = hit - data;
+            while (start > 0 && isLiteralByte(data[start - 1])) {
+                start--;
+            }
+            size_t markerEnd = hit - data + marker.text.size();
+            size_t end = markerEnd + kernels.boundedLength(data + markerEnd, size - markerEnd);
+            from = end;
+
+            // A NUL-terminated string of printable bytes with a name in front of the marker
+            std::string_view literal(data + start, end - start);
+            bool terminated = end < size && (start == 0 || data[start - 1] == '\0');
+            bool printable = std::all_of(literal.begin(), literal.end(), isLiteralByte);
+            bool named = static_cast<size_t>(hit - data) > start && data[hit - data - 1] != '/';
+            if (!terminated || !printable || !named || (marker.atEnd && end != markerEnd)
+                || literal.find('%') != std::string_view::npos) {
+                continue;
+            }
+            hits.emplace_back(start, literal);
+        }
+    }
+}
+
+bool findDlopenCandidates(const std::string &path, const MachOInfo &slice, std::vector<std::string> &candidates) {
+    if (slice.text_stub) {
+        return true;
+    }
+    FileReader file;
+    if (!file.open(path)) {
+        return false;
+    }
+    std::unordered_set<std::string_view> known;
+    for (const auto &dep : slice.deps) {
+        known.insert(dep.name);
+    }
+    known.insert(slice.dylib_id);
+
+    std::unordered_set<std::string> seen;
+    std::vector<char> buffer;
+    for (const auto &section : slice.sections) {
+        if (section.segname != SEG_TEXT || (section.sectname != "__cstring" && section.sectname != "__const")
+            || section.offset == 0 || section.size == 0) {
+            continue;
+        }
+        uint64_t offset = slice.offset + section.offset;
+        if (offset > file.size() || section.size > file.size() - offset) {
+            return false;
+        }
+        const char *data;
+        if (file.mapped()) {
+            data = file.mapped() + offset;
+        } else {
+            buffer.resize(section.size);
+            if (file.read(buffer.data(), buffer.size(), offset) != buffer.size()) {
+                return false;
+            }
+            data = buffer.data();
+        }
+
+        // Markers are searched one after the other; hits go back to section order
+        std::vector<std::pair<size_t, std::string_view>> hits;
+        scanSection(data, section.size, hits);
+        std::sort(hits.begin(), hits.end());
+        for (const auto &hit : hits) {
+            if (!known.count(hit.second) && seen.emplace(hit.second).second) {
+                candidates.emplace_back(hit.second);
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef MACDEPENDENCY_DLOPEN_SCAN_H
+#define MACDEPENDENCY_DLOPEN_SCAN_H
+
+#include <string>
+#include <vector>
+
+#include "macho_parser.h"
+
+
+// Collects the C string literals in a slice's __TEXT,__cstring and
+// __TEXT,__const that look like paths to loadable code: names ending in
+// .dylib, .so, .bundle, or with a .framework/ component. Those are what
+// dlopen() and NSBundle get passed, and they never show up as load commands.
+// Literals naming one of the slice's own dependencies or its install name are
+// left out, as are format strings. Candidates come in section order, each once.
+// Returns false if a section cannot be read.
+bool findDlopenCandidates(const std::string &path, const MachOInfo &slice, std::vector<std::string> &candidates);
+
+#endif // MACDEPENDENCY_DLOPEN_SCAN_H
@@ -0,0 +1,373 @@
+#include "dyld_resolver.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+
+#include <limits.h>
+#include <stdlib.h>
+
+
+static std::vector<std::string> splitSearchPath(const std::string &value) {
+    std::vector<std::string> result;
+    std::string::size_type start = 0;
+    while (start <= value.size()) {
+        auto end = value.find(':', start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        if (end > start) {
+            result.push_back(value.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+static std::string joinPath(const std::string &dir, const std::string &rest) {
+    if (dir.empty()) {
+        return rest;
+    }
+    return std::filesystem::path(dir + "/" + rest).lexically_normal().string();
+}
+
+static std::string directoryOf(const std::string &path) {
+    auto slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+static std::string leafName(const std::string &path) {
+    auto slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static bool startsWith(const std::string &s, const char *prefix) {
+    return s.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+// "Foo.framework/Versions/A/Foo" for ".../Foo.framework/Versions/A/Foo", or an
+// empty string if the install name does not name a framework binary.
+static std::string frameworkPartialPath(const std::string &path) {
+    auto leaf = leafName(path);
+    if (leaf.empty()) {
+        return {};
+    }
+    auto pos = path.rfind(leaf + ".framework/");
+    if (pos == std::string::npos || (pos != 0 && path[pos - 1] != '/')) {
+        return {};
+    }
+    return path.substr(pos);
+}
+
+// DYLD_IMAGE_SUFFIX goes before the extension: libfoo.dylib -> libfoo_debug.dylib
+static std::string withImageSuffix(const std::string &path, const std::string &suffix) {
+    auto slash = path.rfind('/');
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return path + suffix;
+    }
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+// libz.1.dylib -> libz.1.tbd, Foo.framework/Foo -> Foo.framework/Foo.tbd
+static std::string textStubPath(const std::string &path) {
+    static const std::string dylib = ".dylib";
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".tbd") == 0) {
+        return {};
+    }
+    if (path.size() > dylib.size() && path.compare(path.size() - dylib.size(), dylib.size(), dylib) == 0) {
+        return path.substr(0, path.size() - dylib.size()) + ".tbd";
+    }
+    return path + ".tbd";
+}
+
+bool DyldEnvironment::set(const std::string &assignment) {
+    auto equals = assignment.find('=');
+    if (equals == std::string::npos) {
+        return false;
+    }
+    auto name = assignment.substr(0, equals);
+    auto value = assignment.substr(equals + 1);
+    if (name == "DYLD_LIBRARY_PATH") {
+        libraryPath = splitSearchPath(value);
+    } else if (name == "DYLD_FRAMEWORK_PATH") {
+        frameworkPath = splitSearchPath(value);
+    } else if (name == "DYLD_FALLBACK_LIBRARY_PATH") {
+        fallbackLibraryPath = splitSearchPath(value);
+    } else if (name == "DYLD_FALLBACK_FRAMEWORK_PATH") {
+        fallbackFrameworkPath = splitSearchPath(value);
+    } else if (name == "DYLD_IMAGE_SUFFIX") {
+        imageSuffix = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void DyldEnvironment::inheritProcessEnvironment() {
+    for (auto name : {"DYLD_LIBRARY_PATH", "DYLD_FRAMEWORK_PATH", "DYLD_FALLBACK_LIBRARY_PATH",
+                      "DYLD_FALLBACK_FRAMEWORK_PATH", "DYLD_IMAGE_SUFFIX"}) {
+        if (auto value = std::getenv(name)) {
+            set(std::string(name) + "=" + value);
+        }
+    }
+}
+
+const MachOInfo *findSlice(const std::vector<MachOInfo> &slices, cpu_type_t cputype, cpu_subtype_t cpusubtype) {
+    const MachOInfo *sameType = nullptr;
+    for (const auto &slice : slices) {
+        if (slice.cputype != cputype) {
+            continue;
+        }
+        if ((slice.cpusubtype & ~CPU_SUBTYPE_MASK) == (cpusubtype & ~CPU_SUBTYPE_MASK)) {
+            return &slice;
+        }
+        if (!sameType) {
+            sameType = &slice;
+        }
+    }
+    return sameType;
+}
+
+bool isVersionCompatible(const DylibReference &reference, const MachOInfo &provider) {
+    if (provider.dylib_id.empty() || reference.compatibilityVersion == 0xffffffff) {
+        return true;
+    }
+    return provider.compatibility_version >= reference.compatibilityVersion;
+}
+
+DyldResolver::DyldResolver(DyldEnvironment environment, RecordCache *cache, PathMapper mapper)
+    : environment_(std::move(environment)), cache_(cache), mapper_(std::move(mapper)) {
+    for (auto paths : {&environment_.libraryPath, &environment_.frameworkPath,
+                       &environment_.fallbackLibraryPath, &environment_.fallbackFrameworkPath}) {
+        for (auto &dir : *paths) {
+            dir = mapper_.map(dir);
+        }
+    }
+}
+
+const std::vector<MachOInfo> &DyldResolver::parsedFile(const std::string &path) {
+    auto it = parsed_.find(path);
+    if (it == parsed_.end()) {
+        // Only files that were handed over are worth the realpath() for another spelling
+        auto added = added_.empty() ? added_.end() : added_.find(realPath(path));
+        if (added != added_.end()) {
+            auto slices = parsed_.at(added->second);
+            it = parsed_.emplace(path, std::move(slices)).first;
+        } else {
+            std::ostringstream diagnostics;  // a missing candidate is not an error here
+            it = parsed_.emplace(path, parseMachOCached(path, cache_, diagnostics)).first;
+        }
+    }
+    return it->second;
+}
+
+void DyldResolver::addParsedFile(const std::string &path, std::vector<MachOInfo> slices) {
+    auto key = std::filesystem::absolute(path).lexically_normal().string();
+    added_.emplace(realPath(key), key);
+    parsed_[key] = std::move(slices);
+}
+
+const std::string &DyldResolver::realPath(const std::string &path) {
+    auto it = realPaths_.find(path);
+    if (it == realPaths_.end()) {
+        char buffer[PATH_MAX];
+        it = realPaths_.emplace(path, ::realpath(path.c_str(), buffer) ? buffer : path).first;
+    }
+    return it->second;
+}
+
+bool DyldResolver::tryCandidate(const std::string &path, const LoaderContext &context,
+                                Resolution &resolution, const char *via) {
+    // dyld skips files that exist but have no usable slice and keeps searching.
+    auto accept = [&](const std::string &candidate) {
+        if (!findSlice(parsedFile(candidate), context.cputype, context.cpusubtype)) {
+            return false;
+        }
+        resolution.path = candidate;
+        resolution.via = via;
+        return true;
+    };
+    if (!environment_.imageSuffix.empty() && accept(withImageSuffix(path, environment_.imageSuffix))) {
+        return true;
+    }
+    if (accept(path)) {
+        return true;
+    }
+    // SDKs ship a text stub where the dylib would be, like the static linker expects.
+    auto stub = textStubPath(path);
+    return !stub.empty() && accept(stub);
+}
+
+std::string DyldResolver::expandLoaderRelative(const std::string &path, const std::string &loaderPath,
+                                               const std::string &executablePath) const {
+    if (startsWith(path, "@loader_path/")) {
+        return joinPath(directoryOf(loaderPath), path.substr(13));
+    }
+    if (startsWith(path, "@executable_path/")) {
+        return joinPath(directoryOf(executablePath), path.substr(17));
+    }
+    return path;
+}
+
+Resolution DyldResolver::resolve(const std::string &installName, const LoaderContext &context) {
+    // Only the parts of the context that the name actually refers to go into
+    // the key, so plain absolute names are shared across all loaders.
+    std::string key = installName;
+    key += '\0';
+    key += std::to_string(context.cputype) + "/" + std::to_string(context.cpusubtype & ~CPU_SUBTYPE_MASK);
+    if (startsWith(installName, "@loader_path/")) {
+        key += '\0' + directoryOf(context.loaderPath);
+    } else if (startsWith(installName, "@executable_path/")) {
+        key += '\0' + directoryOf(context.executablePath);
+    } else if (startsWith(installName, "@rpath/")) {
+        for (const auto &rpath : context.rpaths) {
+            key += '\0' + rpath;
+        }
+    }
+    auto cached = resolutions_.find(key);
+    if (cached != resolutions_.end()) {
+        return cached->second;
+    }
+
+    Resolution resolution;
+    auto leaf = leafName(installName);
+    auto frameworkPartial = frameworkPartialPath(installName);
+    auto found = [&]() {
+        // DYLD_FRAMEWORK_PATH and DYLD_LIBRARY_PATH override the install name.
+        if (!frameworkPartial.empty()) {
+            for (const auto &dir : environment_.frameworkPath) {
+                if (tryCandidate(joinPath(dir, frameworkPartial), context, resolution, "DYLD_FRAMEWORK_PATH")) {
+                    return true;
+                }
+            }
+        }
+        for (const auto &dir : environment_.libraryPath) {
+            if (tryCandidate(joinPath(dir, leaf), context, resolution, "DYLD_LIBRARY_PATH")) {
+                return true;
+            }
+        }
+
+        // The install name itself
+        if (startsWith(installName, "@rpath/")) {
+            for (const auto &rpath : context.rpaths) {
+                if (tryCandidate(joinPath(rpath, installName.substr(7)), context, resolution, "rpath")) {
+                    return true;
+                }
+            }
+        } else if (startsWith(installName, "@loader_path/")) {
+            auto path = expandLoaderRelative(installName, context.loaderPath, context.executablePath);
+            if (tryCandidate(path, context, resolution, "@loader_path")) {
+                return true;
+            }
+        } else if (startsWith(installName, "@executable_path/")) {
+            auto path = expandLoaderRelative(installName, context.loaderPath, context.executablePath);
+            if (tryCandidate(path, context, resolution, "@executable_path")) {
+                return true;
+            }
+        } else if (tryCandidate(mapper_.map(installName), context, resolution, "install name")) {
+            return true;
+        }
+
+        // Fallback paths, searched by framework partial path or leaf name
+        if (!frameworkPartial.empty()) {
+            for (const auto &dir : environment_.fallbackFrameworkPath) {
+                if (tryCandidate(joinPath(dir, frameworkPartial), context, resolution,
+                                 "DYLD_FALLBACK_FRAMEWORK_PATH")) {
+                    return true;
+                }
+            }
+        }
+        for (const auto &dir : environment_.fallbackLibraryPath) {
+            if (tryCandidate(joinPath(dir, leaf), context, resolution, "DYLD_FALLBACK_LIBRARY_PATH")) {
+                return true;
+            }
+        }
+        return false;
+    };
+    if (!found()) {
+        resolution = Resolution {};
+    }
+    resolutions_.emplace(std::move(key), resolution);
+    return resolution;
+}
+
+struct DyldResolver::LoadState {
+    Closure &closure;
+    std::string executablePath;
+    cpu_type_t cputype;
+    cpu_subtype_t cpusubtype;
+    std::unordered_map<std::string, size_t> loaded;  // real path -> image index
+    std::vector<bool> dependentsLoaded;
+};
+
+std::vector<Closure> DyldResolver::resolveClosures(const std::string &rootPath, const std::string &executablePath) {
+    auto root = std::filesystem::absolute(rootPath).lexically_normal().string();
+    auto executable = executablePath.empty()
+                      ? root
+                      : std::filesystem::absolute(executablePath).lexically_normal().string();
+
+    std::vector<Closure> closures;
+    auto slices = parsedFile(root);
+    for (const auto &slice : slices) {
+        Closure closure;
+        closure.arch = slice.arch;
+        closure.images.push_back({root, "", slice});
+
+        LoadState state {closure, executable, slice.cputype, slice.cpusubtype, {}, {true}};
+        state.loaded.emplace(realPath(root), 0);
+        loadDependents(state, 0, {});
+        closures.push_back(std::move(closure));
+    }
+    return closures;
+}
+
+// Mirrors dyld's recursive library loading: all direct dependents of an image
+// are loaded first, then each of them gets its own dependents loaded in turn.
+void DyldResolver::loadDependents(LoadState &state, size_t index, const std::vector<std::string> &inheritedRpaths) {
+    auto &closure = state.closure;
+    LoaderContext context;
+    context.executablePath = state.executablePath;
+    context.loaderPath = closure.images[index].path;
+    context.cputype = state.cputype;
+    context.cpusubtype = state.cpusubtype;
+    // LC_RPATHs may be relative to the image that declares them, or name a
+    // directory of the analyzed system.
+    for (const auto &rpath : closure.images[index].info.rpaths) {
+        context.rpaths.push_back(rpath[0] == '@'
+                                 ? expandLoaderRelative(rpath, context.loaderPath, context.executablePath)
+                                 : mapper_.map(rpath));
+    }
+    context.rpaths.insert(context.rpaths.end(), inheritedRpaths.begin(), inheritedRpaths.end());
+
+    std::vector<size_t> dependents;
+    const auto deps = closure.images[index].info.deps;
+    for (const auto &dep : deps) {
+        auto resolution = resolve(dep.name, context);
+        size_t to = Closure::kNotLoaded;
+        if (!resolution.path.empty()) {
+            auto inserted = state.loaded.emplace(realPath(resolution.path), closure.images.size());
+            to = inserted.first->second;
+            if (inserted.second) {
+                auto slice = findSlice(parsedFile(resolution.path), state.cputype, state.cpusubtype);
+                closure.images.push_back({resolution.path, dep.name, *slice});
+                state.dependentsLoaded.push_back(false);
+            }
+            dependents.push_back(to);
+        }
+        ClosureEdge edge {index, to, dep, std::move(resolution)};
+        // Checked here, while the provider's load commands are at hand
+        edge.incompatibleVersion = to != Closure::kNotLoaded && !isVersionCompatible(dep, closure.images[to].info);
+        closure.edges.push_back(std::move(edge));
+    }
+
+    for (auto dependent : dependents) {
+        if (!state.dependentsLoaded[dependent]) {
+            state.dependentsLoaded[dependent] = true;
+            loadDependents(state, dependent, context.rpaths);
+        }
+    }
+}
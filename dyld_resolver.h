@@ -0,0 +1,126 @@
+#ifndef MACDEPENDENCY_DYLD_RESOLVER_H
+#define MACDEPENDENCY_DYLD_RESOLVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "macho_parser.h"
+#include "path_mapper.h"
+#include "record_cache.h"
+
+
+// Search settings dyld takes from the DYLD_* environment variables.
+// The fallback paths start out with the defaults dyld uses when they are unset.
+struct DyldEnvironment {
+    std::vector<std::string> libraryPath;            // DYLD_LIBRARY_PATH
+    std::vector<std::string> frameworkPath;          // DYLD_FRAMEWORK_PATH
+    std::vector<std::string> fallbackLibraryPath {"/usr/local/lib", "/usr/lib"};
+    std::vector<std::string> fallbackFrameworkPath {"/Library/Frameworks", "/System/Library/Frameworks"};
+    std::string imageSuffix;                         // DYLD_IMAGE_SUFFIX
+
+    // Applies a NAME=VALUE setting such as "DYLD_LIBRARY_PATH=/opt/lib:/usr/local/lib".
+    // Returns false if NAME is not one of the variables above.
+    bool set(const std::string &assignment);
+
+    // Applies the DYLD_* variables of this process.
+    void inheritProcessEnvironment();
+};
+
+// Everything the expansion of an install name depends on besides the name itself.
+struct LoaderContext {
+    std::string executablePath;       // main executable, for @executable_path
+    std::string loaderPath;           // image containing the load command, for @loader_path
+    std::vector<std::string> rpaths;  // expanded LC_RPATHs of the loader and the images that loaded it
+    cpu_type_t cputype = 0;           // architecture of the process
+    cpu_subtype_t cpusubtype = 0;
+};
+
+struct Resolution {
+    std::string path;         // file dyld would load, empty if nothing loadable was found
+    const char *via = "";     // the search rule that found it
+};
+
+struct ClosureImage {
+    std::string path;
+    std::string installName;  // name it was first loaded by, empty for the root
+    MachOInfo info;           // slice matching the root's architecture
+};
+
+struct ClosureEdge {
+    size_t from;
+    size_t to;                // Closure::kNotLoaded if the dependency was not found
+    DylibReference reference;
+    Resolution resolution;
+    bool incompatibleVersion = false;  // dyld would refuse the provider, see isVersionCompatible()
+};
+
+// Images one architecture of a root loads, in dyld's load order.
+struct Closure {
+    static constexpr size_t kNotLoaded = SIZE_MAX;
+
+    std::string arch;
+    std::vector<ClosureImage> images;  // images[0] is the root
+    std::vector<ClosureEdge> edges;
+};
+
+// Resolves install names the way dyld searches for them at launch.
+//
+// Resolutions are memoized per (install name, loader context), and every file
+// is parsed at most once, so the closures of many roots sharing the same
+// libraries cost little more than the first one. With a cache, files parsed
+// in earlier runs are not parsed again. Not thread-safe.
+//
+// Absolute install names, LC_RPATHs and DYLD_* search paths name files of the
+// system being analyzed, and go through `mapper` before they are looked up.
+// Paths derived from the root (@executable_path, @loader_path) are already
+// paths on this machine.
+class DyldResolver {
+public:
+    explicit DyldResolver(DyldEnvironment environment, RecordCache *cache = nullptr,
+                          PathMapper mapper = PathMapper());
+
+    Resolution resolve(const std::string &installName, const LoaderContext &context);
+
+    // One closure per architecture of the root. An empty executablePath means
+    // the root is the main executable.
+    std::vector<Closure> resolveClosures(const std::string &rootPath, const std::string &executablePath);
+
+    // Parse result of a file, cached.
+    const std::vector<MachOInfo> &parsedFile(const std::string &path);
+
+    // Hands over a file parsed elsewhere, such as while walking a bundle. It is
+    // used for every spelling of the path that resolves to the same file.
+    void addParsedFile(const std::string &path, std::vector<MachOInfo> slices);
+
+    // realpath(), memoized; the path itself if it does not resolve.
+    const std::string &realPath(const std::string &path);
+
+private:
+    struct LoadState;
+
+    bool tryCandidate(const std::string &path, const LoaderContext &context, Resolution &resolution, const char *via);
+    void loadDependents(LoadState &state, size_t index, const std::vector<std::string> &inheritedRpaths);
+    std::string expandLoaderRelative(const std::string &path, const std::string &loaderPath,
+                                     const std::string &executablePath) const;
+
+    DyldEnvironment environment_;
+    RecordCache *cache_;
+    PathMapper mapper_;
+    std::unordered_map<std::string, Resolution> resolutions_;
+    std::unordered_map<std::string, std::vector<MachOInfo>> parsed_;
+    std::unordered_map<std::string, std::string> added_;  // real path -> key in parsed_
+    std::unordered_map<std::string, std::string> realPaths_;
+};
+
+// dyld refuses a dylib whose LC_ID_DYLIB compatibility version is older than
+// the compatibility version the consumer recorded when it was linked.
+// 0xffffffff in the consumer matches any version.
+bool isVersionCompatible(const DylibReference &reference, const MachOInfo &provider);
+
+// The slice dyld would pick for a process of the given architecture, or nullptr.
+const MachOInfo *findSlice(const std::vector<MachOInfo> &slices, cpu_type_t cputype, cpu_subtype_t cpusubtype);
+
+#endif // MACDEPENDENCY_DYLD_RESOLVER_H
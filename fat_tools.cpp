@@ -0,0 +1,193 @@
+#include "fat_tools.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mach-o/fat.h>
+
+#include "file_copy.h"
+#include "macho_parser.h"
+
+
+ThinResult thinFile(const std::string &input, const std::string &output, const std::string &arch,
+                    std::string &error) {
+    std::ostringstream diagnostics;
+    auto slices = parseMachO(input, diagnostics);
+    if (slices.empty()) {
+        return ThinResult::NotMachO;
+    }
+    auto slice = std::find_if(slices.begin(), slices.end(), [&](const MachOInfo &info) {
+        return info.arch == arch;
+    });
+    if (slice == slices.end()) {
+        return ThinResult::NoSuchArch;
+    }
+    // Slices of a universal binary never start at offset 0
+    if (slice->offset == 0) {
+        return ThinResult::AlreadyThin;
+    }
+
+    int in = open(input.c_str(), O_RDONLY);
+    struct stat st {};
+    if (in < 0 || fstat(in, &st) != 0) {
+        error = std::strerror(errno);
+        if (in >= 0) {
+            close(in);
+        }
+        return ThinResult::Failed;
+    }
+    AtomicFile out(output.empty() ? input : output, st.st_mode & 07777);
+    bool ok = out.fd() >= 0 && copyFileRange(in, slice->offset, out.fd(), 0, slice->size) && out.commit();
+    if (!ok) {
+        error = std::strerror(errno);
+    }
+    close(in);
+    return ok ? ThinResult::Thinned : ThinResult::Failed;
+}
+
+uint32_t sliceAlignment(cpu_type_t cputype) {
+    switch (cputype) {
+        case CPU_TYPE_ARM:
+        case CPU_TYPE_ARM64:
+        case CPU_TYPE_ARM64_32:
+            return 14;  // 16 KB pages
+        default:
+            return 12;
+    }
+}
+
+template <typename FatArchType>
+static void appendBigEndian(std::vector<char> &header, const FatArchType &fa) {
+    FatArchType swapped = fa;
+    swapped.cputype = OSSwapInt32(fa.cputype);
+    swapped.cpusubtype = OSSwapInt32(fa.cpusubtype);
+    if constexpr(sizeof(fa.offset) == sizeof(uint64_t)) {
+        swapped.offset = OSSwapInt64(fa.offset);
+        swapped.size = OSSwapInt64(fa.size);
+    } else {
+        swapped.offset = OSSwapInt32(fa.offset);
+        swapped.size = OSSwapInt32(fa.size);
+    }
+    swapped.align = OSSwapInt32(fa.align);
+    auto bytes = reinterpret_cast<const char *>(&swapped);
+    header.insert(header.end(), bytes, bytes + sizeof(swapped));
+}
+
+std::vector<char> layoutFatFile(std::vector<FatSlice> &slices, uint64_t &end) {
+    // Lay out with 32-bit entries first, and switch if anything does not fit.
+    bool use64BitEntries = false;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t entrySize = use64BitEntries ? sizeof(struct fat_arch_64) : sizeof(struct fat_arch);
+        end = sizeof(struct fat_header) + slices.size() * entrySize;
+        bool fits32 = true;
+        for (auto &slice : slices) {
+            uint64_t alignment = uint64_t(1) << slice.align;
+            slice.offset = (end + alignment - 1) & ~(alignment - 1);
+            end = slice.offset + slice.size;
+            fits32 = fits32 && slice.offset <= UINT32_MAX && slice.size <= UINT32_MAX;
+        }
+        if (fits32 || use64BitEntries) {
+            break;
+        }
+        use64BitEntries = true;
+    }
+
+    std::vector<char> header;
+    struct fat_header fh {};
+    fh.magic = OSSwapInt32(use64BitEntries ? FAT_MAGIC_64 : FAT_MAGIC);
+    fh.nfat_arch = OSSwapInt32(static_cast<uint32_t>(slices.size()));
+    header.insert(header.end(), reinterpret_cast<const char *>(&fh), reinterpret_cast<const char *>(&fh + 1));
+    for (const auto &slice : slices) {
+        if (use64BitEntries) {
+            struct fat_arch_64 fa {slice.cputype, slice.cpusubtype, slice.offset, slice.size, slice.align, 0};
+            appendBigEndian(header, fa);
+        } else {
+            struct fat_arch fa {slice.cputype, slice.cpusubtype, static_cast<uint32_t>(slice.offset),
+                                static_cast<uint32_t>(slice.size), slice.align};
+            appendBigEndian(header, fa);
+        }
+    }
+    return header;
+}
+
+bool mergeArchitectures(const std::vector<std::string> &inputs, const std::string &output, std::string &error) {
+    struct Input {
+        std::string path;
+        MachOInfo info;
+        uint32_t align;
+    };
+    std::vector<Input> inputSlices;
+    for (const auto &path : inputs) {
+        std::ostringstream diagnostics;
+        auto result = parseMachO(path, diagnostics);
+        if (result.size() != 1 || result.front().offset != 0) {
+            error = path + " is not a thin Mach-O file";
+            return false;
+        }
+        const auto &info = result.front();
+        for (const auto &other : inputSlices) {
+            if (other.info.cputype == info.cputype
+                && (other.info.cpusubtype & ~CPU_SUBTYPE_MASK) == (info.cpusubtype & ~CPU_SUBTYPE_MASK)) {
+                error = path + " and " + other.path + " have the same architecture (" + info.arch + ")";
+                return false;
+            }
+        }
+        inputSlices.push_back({path, info, sliceAlignment(info.cputype)});
+    }
+    if (inputSlices.empty()) {
+        error = "no input files";
+        return false;
+    }
+    std::stable_sort(inputSlices.begin(), inputSlices.end(), [](const Input &a, const Input &b) {
+        return a.align < b.align;
+    });
+
+    std::vector<FatSlice> slices;
+    for (const auto &input : inputSlices) {
+        slices.push_back({input.info.cputype, input.info.cpusubtype, input.info.size, input.align});
+    }
+    uint64_t end = 0;
+    auto header = layoutFatFile(slices, end);
+
+    // errno is taken right where something fails; close() and the temporary
+    // file's cleanup may change it afterwards.
+    struct stat st {};
+    if (stat(inputSlices.front().path.c_str(), &st) != 0) {
+        error = inputSlices.front().path + ": " + std::strerror(errno);
+        return false;
+    }
+    AtomicFile out(output, st.st_mode & 07777);
+    // Sizing the file up front leaves the alignment gaps as holes of zeros.
+    if (out.fd() < 0 || ftruncate(out.fd(), static_cast<off_t>(end)) != 0
+        || !writeAt(out.fd(), header.data(), header.size(), 0)) {
+        error = std::strerror(errno);
+        return false;
+    }
+    for (size_t i = 0; i < slices.size(); i++) {
+        const auto &path = inputSlices[i].path;
+        int in = open(path.c_str(), O_RDONLY);
+        if (in < 0) {
+            error = path + ": " + std::strerror(errno);
+            return false;
+        }
+        bool copied = copyFileRange(in, 0, out.fd(), slices[i].offset, slices[i].size);
+        int copyError = errno;
+        close(in);
+        if (!copied) {
+            error = "copying " + path + ": " + std::strerror(copyError);
+            return false;
+        }
+    }
+    if (!out.commit()) {
+        error = std::strerror(errno);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef MACDEPENDENCY_FAT_TOOLS_H
+#define MACDEPENDENCY_FAT_TOOLS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <mach/machine.h>
+
+
+enum class ThinResult {
+    Thinned,
+    AlreadyThin,
+    NoSuchArch,
+    NotMachO,
+    Failed,
+};
+
+// Extracts the slice for `arch` (as named in the listing, e.g. "arm64") from a
+// universal binary, like lipo -thin. The slice is copied by the kernel and
+// renamed into place, over `input` itself when `output` is empty.
+// `error` describes a Failed result.
+ThinResult thinFile(const std::string &input, const std::string &output, const std::string &arch,
+                    std::string &error);
+
+// Builds a universal binary from thin Mach-O files, like lipo -create. Slices
+// are aligned to 2^14 for ARM and 2^12 for everything else, placed in order
+// of increasing alignment, and described with fat_arch_64 entries if any of
+// them lies beyond 4 GB. Returns false with `error` set on failure.
+bool mergeArchitectures(const std::vector<std::string> &inputs, const std::string &output, std::string &error);
+
+// One slice of a universal binary being laid out.
+struct FatSlice {
+    cpu_type_t cputype;
+    cpu_subtype_t cpusubtype;
+    uint64_t size;
+    uint32_t align;       // log2 of the alignment, see sliceAlignment()
+    uint64_t offset = 0;  // assigned by layoutFatFile()
+};
+
+// The alignment lipo uses for slices of an architecture, as a power of two.
+// Also the page size the architecture's segments are aligned to.
+uint32_t sliceAlignment(cpu_type_t cputype);
+
+// Places the slices in the given order, each at the next offset matching its
+// alignment, and returns the big-endian fat header that describes them.
+// `end` receives the size of the whole file.
+std::vector<char> layoutFatFile(std::vector<FatSlice> &slices, uint64_t &end);
+
+#endif // MACDEPENDENCY_FAT_TOOLS_H
@@ -0,0 +1,187 @@
+#include "file_copy.h"
+
+#include <cerrno>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+
+static constexpr size_t kCopyBufferSize = 1 << 20;
+
+static bool copyWithBuffer(int in, uint64_t inOffset, int out, uint64_t outOffset, uint64_t length) {
+    std::vector<char> buffer(static_cast<size_t>(std::min<uint64_t>(length, kCopyBufferSize)));
+    while (length > 0) {
+        auto chunk = static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+        ssize_t got = pread(in, buffer.data(), chunk, static_cast<off_t>(inOffset));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;  // read error, or the input is shorter than expected
+        }
+        for (ssize_t done = 0; done < got;) {
+            ssize_t put = pwrite(out, buffer.data() + done, static_cast<size_t>(got - done),
+                                 static_cast<off_t>(outOffset + done));
+            if (put < 0 && errno == EINTR) {
+                continue;
+            }
+            if (put <= 0) {
+                return false;
+            }
+            done += put;
+        }
+        inOffset += got;
+        outOffset += got;
+        length -= got;
+    }
+    return true;
+}
+
+#ifdef __linux__
+// Returns false with errno set if the kernel cannot copy between these files,
+// after copying as much as it could; the offsets and length are advanced.
+static bool copyInKernel(int in, uint64_t &inOffset, int out, uint64_t &outOffset, uint64_t &length) {
+    while (length > 0) {
+        auto inPos = static_cast<off_t>(inOffset);
+        auto outPos = static_cast<off_t>(outOffset);
+        ssize_t copied = copy_file_range(in, &inPos, out, &outPos, static_cast<size_t>(length), 0);
+        if (copied < 0 && errno == EINTR) {
+            continue;
+        }
+        if (copied <= 0) {
+            break;
+        }
+        inOffset += copied;
+        outOffset += copied;
+        length -= copied;
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    // Older kernels and some file systems reject copy_file_range; sendfile
+    // still avoids the copy to user space but writes at the file position.
+    if (lseek(out, static_cast<off_t>(outOffset), SEEK_SET) < 0) {
+        return false;
+    }
+    while (length > 0) {
+        auto inPos = static_cast<off_t>(inOffset);
+        ssize_t copied = sendfile(out, in, &inPos, static_cast<size_t>(length));
+        if (copied < 0 && errno == EINTR) {
+            continue;
+        }
+        if (copied <= 0) {
+            return false;
+        }
+        inOffset += copied;
+        outOffset += copied;
+        length -= copied;
+    }
+    return true;
+}
+#endif
+
+bool copyFileRange(int in, uint64_t inOffset, int out, uint64_t outOffset, uint64_t length) {
+#ifdef __linux__
+    if (copyInKernel(in, inOffset, out, outOffset, length)) {
+        return true;
+    }
+#endif
+    return copyWithBuffer(in, inOffset, out, outOffset, length);
+}
+
+bool writeZeros(int fd, uint64_t offset, uint64_t length) {
+    static const char zeros[4096] = {};
+    while (length > 0) {
+        auto chunk = static_cast<size_t>(std::min<uint64_t>(length, sizeof(zeros)));
+        ssize_t put = pwrite(fd, zeros, chunk, static_cast<off_t>(offset));
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return false;
+        }
+        offset += put;
+        length -= put;
+    }
+    return true;
+}
+
+bool readAt(int fd, void *data, size_t size, uint64_t offset) {
+    auto bytes = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t got = pread(fd, bytes, size, static_cast<off_t>(offset));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        offset += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool writeAt(int fd, const void *data, size_t size, uint64_t offset) {
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t put = pwrite(fd, bytes, size, static_cast<off_t>(offset));
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return false;
+        }
+        bytes += put;
+        offset += put;
+        size -= put;
+    }
+    return true;
+}
+
+AtomicFile::AtomicFile(std::string path, mode_t mode)
+    : path_(std::move(path)), tempPath_(path_ + ".XXXXXX") {
+    fd_ = mkstemp(&tempPath_[0]);
+    if (fd_ >= 0 && fchmod(fd_, mode) != 0) {
+        close(fd_);
+        unlink(tempPath_.c_str());
+        fd_ = -1;
+    }
+}
+
+AtomicFile::~AtomicFile() {
+    if (fd_ >= 0) {
+        close(fd_);
+        unlink(tempPath_.c_str());
+    }
+}
+
+bool AtomicFile::commit(bool replace) {
+    if (fd_ < 0) {
+        return false;
+    }
+    bool ok = fsync(fd_) == 0;
+    ok = close(fd_) == 0 && ok;
+    fd_ = -1;
+    if (!replace) {
+        // link() fails rather than replace the destination
+        ok = ok && link(tempPath_.c_str(), path_.c_str()) == 0;
+        unlink(tempPath_.c_str());
+        return ok;
+    }
+    if (!ok || rename(tempPath_.c_str(), path_.c_str()) != 0) {
+        unlink(tempPath_.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef MACDEPENDENCY_FILE_COPY_H
+#define MACDEPENDENCY_FILE_COPY_H
+
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+
+// Copies `length` bytes from one file to another at the given offsets,
+// leaving the file positions alone. Uses copy_file_range() or sendfile()
+// where available so the data never passes through user space, and falls
+// back to pread()/pwrite() otherwise.
+bool copyFileRange(int in, uint64_t inOffset, int out, uint64_t outOffset, uint64_t length);
+
+// Writes `length` zero bytes at `offset`.
+bool writeZeros(int fd, uint64_t offset, uint64_t length);
+
+// pread()/pwrite() the whole range, retrying short transfers.
+// readAt() fails if the file ends before `size` bytes were read.
+bool readAt(int fd, void *data, size_t size, uint64_t offset);
+bool writeAt(int fd, const void *data, size_t size, uint64_t offset);
+
+// A file that is written under a temporary name in the destination directory
+// and renamed over the destination on commit(), so readers see either the old
+// or the complete new contents. Dropping it without commit() removes the
+// temporary file.
+class AtomicFile {
+public:
+    AtomicFile(std::string path, mode_t mode);
+    ~AtomicFile();
+
+    AtomicFile(const AtomicFile &) = delete;
+    AtomicFile &operator=(const AtomicFile &) = delete;
+
+    // -1 if the temporary file could not be created
+    int fd() const { return fd_; }
+
+    // With `replace` false, an existing destination is left alone and
+    // commit() fails.
+    bool commit(bool replace = true);
+
+private:
+    std::string path_;
+    std::string tempPath_;
+    int fd_ = -1;
+};
+
+#endif // MACDEPENDENCY_FILE_COPY_H
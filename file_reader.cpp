@@ -0,0 +1,432 @@
+#include "file_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <sys/mount.h>
+#include <sys/param.h>
+#else
+#include <sys/vfs.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define MACDEPENDENCY_HAVE_IO_URING 1
+#endif
+
+
+// Local files from this size on are mapped rather than read
+static constexpr uint64_t kMmapThreshold = 1024 * 1024;
+// O_DIRECT transfers start and end on this boundary
+static constexpr uint64_t kDirectAlignment = 4096;
+
+struct BackendStats {
+    std::atomic<uint64_t> files {0};
+    std::atomic<uint64_t> reads {0};
+    std::atomic<uint64_t> bytes {0};
+    std::atomic<uint64_t> mapped {0};     // bytes
+    std::atomic<uint64_t> fallbacks {0};  // files, or reads, that had to use pread instead
+};
+
+static constexpr size_t kBackendCount = static_cast<size_t>(IoBackend::Direct) + 1;
+static BackendStats backendStats[kBackendCount];
+static IoBackend forcedBackend = IoBackend::Auto;
+
+static BackendStats &statsOf(IoBackend backend);
+static bool isNetworkFileSystem(int fd);
+static IoBackend chooseBackend(int fd, uint64_t size);
+static size_t preadUpTo(int fd, char *data, size_t size, uint64_t offset);
+static bool ioUringUsable();
+static bool ioUringRead(int fd, char *data, size_t size, uint64_t offset, size_t &done);
+
+
+// IMPLEMENTATION BELOW
+
+const char *ioBackendName(IoBackend backend) {
+    switch (backend) {
+        case IoBackend::Auto:
+            return "auto";
+        case IoBackend::Pread:
+            return "pread";
+        case IoBackend::Mmap:
+            return "mmap";
+        case IoBackend::IoUring:
+            return "io_uring";
+        case IoBackend::Direct:
+            return "direct";
+    }
+    return "";
+}
+
+bool parseIoBackend(const std::string &name, IoBackend &backend) {
+    for (size_t i = 0; i < kBackendCount; i++) {
+        auto candidate = static_cast<IoBackend>(i);
+        if (name == ioBackendName(candidate)) {
+            backend = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void setIoBackend(IoBackend backend) {
+    forcedBackend = backend;
+}
+
+void printIoStats(std::ostream &out) {
+    out << "io:\n";
+    for (size_t i = 1; i < kBackendCount; i++) {
+        const auto &stats = backendStats[i];
+        if (stats.files == 0 && stats.fallbacks == 0) {
+            continue;
+        }
+        out << "  " << ioBackendName(static_cast<IoBackend>(i)) << ":\n";
+        out << "    files: " << stats.files << '\n';
+        out << "    reads: " << stats.reads << '\n';
+        out << "    bytes: " << stats.bytes << '\n';
+        if (stats.mapped != 0) {
+            out << "    mapped: " << stats.mapped << '\n';
+        }
+        if (stats.fallbacks != 0) {
+            out << "    fallbacks: " << stats.fallbacks << '\n';
+        }
+    }
+}
+
+static BackendStats &statsOf(IoBackend backend) {
+    return backendStats[static_cast<size_t>(backend)];
+}
+
+// Mappings of files on network and FUSE file systems fault over the network
+// page by page, and raise SIGBUS when the file shrinks on another machine.
+static bool isNetworkFileSystem(int fd) {
+    struct statfs fs {};
+    if (fstatfs(fd, &fs) != 0) {
+        return false;
+    }
+#ifdef __APPLE__
+    return (fs.f_flags & MNT_LOCAL) == 0;
+#else
+    switch (static_cast<uint32_t>(fs.f_type)) {
+        case 0x6969:      // NFS
+        case 0x517b:      // SMB
+        case 0xff534d42:  // CIFS
+        case 0xfe534d42:  // SMB2
+        case 0x65735546:  // FUSE
+        case 0x00c36400:  // Ceph
+        case 0x01021997:  // 9P
+        case 0x5346414f:  // AFS
+            return true;
+        default:
+            return false;
+    }
+#endif
+}
+
+static IoBackend chooseBackend(int fd, uint64_t size) {
+    if (forcedBackend != IoBackend::Auto) {
+        return forcedBackend;
+    }
+    if (size < kMmapThreshold || isNetworkFileSystem(fd)) {
+        return IoBackend::Pread;
+    }
+    return IoBackend::Mmap;
+}
+
+FileReader::~FileReader() {
+    if (mapped_) {
+        munmap(const_cast<char *>(mapped_), size_);
+    }
+    if (directFd_ >= 0) {
+        close(directFd_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool FileReader::open(const std::string &path) {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd_ < 0 || fstat(fd_, &st) != 0) {
+        return false;
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+
+    // There is nothing to map in an empty file
+    auto wanted = chooseBackend(fd_, size_);
+    if (wanted == IoBackend::Mmap && size_ == 0) {
+        wanted = IoBackend::Pread;
+    }
+    backend_ = wanted;
+    if (wanted == IoBackend::Mmap) {
+        void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapping != MAP_FAILED) {
+            mapped_ = static_cast<const char *>(mapping);
+            statsOf(IoBackend::Mmap).mapped += size_;
+        } else {
+            backend_ = IoBackend::Pread;
+        }
+    } else if (wanted == IoBackend::IoUring) {
+        if (!ioUringUsable()) {
+            backend_ = IoBackend::Pread;
+        }
+    } else if (wanted == IoBackend::Direct) {
+#ifdef O_DIRECT
+        directFd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+#else
+        directFd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (directFd_ >= 0 && fcntl(directFd_, F_NOCACHE, 1) != 0) {
+            close(directFd_);
+            directFd_ = -1;
+        }
+#endif
+        if (directFd_ < 0) {
+            // tmpfs and some others refuse O_DIRECT
+            backend_ = IoBackend::Pread;
+        }
+    }
+    if (backend_ != wanted) {
+        statsOf(wanted).fallbacks++;
+    }
+    statsOf(backend_).files++;
+    return true;
+}
+
+size_t FileReader::read(char *data, size_t size, uint64_t offset) {
+    size_t done = 0;
+    switch (backend_) {
+        case IoBackend::Mmap:
+            if (offset < size_) {
+                done = static_cast<size_t>(std::min<uint64_t>(size, size_ - offset));
+                std::memcpy(data, mapped_ + offset, done);
+            }
+            break;
+        case IoBackend::Direct:
+            done = readDirect(data, size, offset);
+            break;
+        case IoBackend::IoUring:
+            if (!ioUringRead(fd_, data, size, offset, done)) {
+                // Nothing on this thread goes through a ring any more; finish with pread
+                statsOf(IoBackend::IoUring).fallbacks++;
+                done += preadUpTo(fd_, data + done, size - done, offset + done);
+            }
+            break;
+        default:
+            done = preadUpTo(fd_, data, size, offset);
+            break;
+    }
+    auto &stats = statsOf(backend_);
+    stats.reads++;
+    stats.bytes += done;
+    return done;
+}
+
+size_t FileReader::readDirect(char *data, size_t size, uint64_t offset) {
+    if (size == 0 || offset >= size_) {
+        return 0;
+    }
+    // Transfers of whole aligned blocks into an aligned buffer, of which the asked part is copied out
+    uint64_t start = offset & ~(kDirectAlignment - 1);
+    uint64_t end = (std::min<uint64_t>(offset + size, size_) + kDirectAlignment - 1) & ~(kDirectAlignment - 1);
+    auto length = static_cast<size_t>(end - start);
+    std::unique_ptr<char, decltype(&free)> buffer(static_cast<char *>(aligned_alloc(kDirectAlignment, length)),
+                                                  &free);
+    if (!buffer) {
+        return preadUpTo(fd_, data, size, offset);
+    }
+    size_t got = preadUpTo(directFd_, buffer.get(), length, start);
+    if (got <= offset - start) {
+        return 0;
+    }
+    size_t done = std::min<size_t>(size, got - static_cast<size_t>(offset - start));
+    std::memcpy(data, buffer.get() + (offset - start), done);
+    return done;
+}
+
+static size_t preadUpTo(int fd, char *data, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = pread(fd, data + done, size - done, static_cast<off_t>(offset + done));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            break;
+        }
+        done += static_cast<size_t>(got);
+    }
+    return done;
+}
+
+#ifdef MACDEPENDENCY_HAVE_IO_URING
+
+// A one-entry io_uring per thread, driven by raw system calls: every read is
+// submitted and waited for with a single io_uring_enter().
+class IoUring {
+public:
+    ~IoUring() {
+        if (sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqesSize_);
+        }
+        if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+            munmap(cqRing_, cqSize_);
+        }
+        if (sqRing_ != MAP_FAILED) {
+            munmap(sqRing_, sqSize_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool setup() {
+        struct io_uring_params params {};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, 1, &params));
+        if (fd_ < 0) {
+            return false;
+        }
+        sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) {
+            sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+        }
+        sqRing_ = mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED) {
+            return false;
+        }
+        cqRing_ = singleMap ? sqRing_
+                            : mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                                   IORING_OFF_CQ_RING);
+        sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (cqRing_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            return false;
+        }
+        auto sq = static_cast<char *>(sqRing_);
+        auto cq = static_cast<char *>(cqRing_);
+        sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Bytes read, or -errno
+    int64_t read(int fd, char *data, uint32_t size, uint64_t offset) {
+        unsigned tail = *sqTail_;
+        unsigned index = tail & sqMask_;
+        auto sqe = static_cast<struct io_uring_sqe *>(sqes_) + index;
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = size;
+        sqe->off = offset;
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+        while (true) {
+            long entered = syscall(__NR_io_uring_enter, fd_, 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (entered >= 0 || errno != EINTR) {
+                break;
+            }
+        }
+        unsigned head = *cqHead_;
+        if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+            return -EIO;
+        }
+        int64_t result = cqes_[head & cqMask_].res;
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        return result;
+    }
+
+private:
+    int fd_ = -1;
+    void *sqRing_ = MAP_FAILED;
+    void *cqRing_ = MAP_FAILED;
+    void *sqes_ = MAP_FAILED;
+    size_t sqSize_ = 0;
+    size_t cqSize_ = 0;
+    size_t sqesSize_ = 0;
+    unsigned *sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned *sqArray_ = nullptr;
+    unsigned *cqHead_ = nullptr;
+    unsigned *cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    struct io_uring_cqe *cqes_ = nullptr;
+};
+
+// False once the kernel turned out to have no io_uring, to refuse it, or to
+// have one without IORING_OP_READ
+static std::atomic<bool> ioUringAvailable {true};
+
+static IoUring *threadRing() {
+    thread_local std::unique_ptr<IoUring> ring;
+    if (!ring && ioUringAvailable) {
+        ring = std::make_unique<IoUring>();
+        if (!ring->setup()) {
+            ring.reset();
+            ioUringAvailable = false;
+        }
+    }
+    return ioUringAvailable ? ring.get() : nullptr;
+}
+
+static bool ioUringUsable() {
+    return threadRing() != nullptr;
+}
+
+static bool ioUringRead(int fd, char *data, size_t size, uint64_t offset, size_t &done) {
+    done = 0;
+    auto ring = threadRing();
+    if (!ring) {
+        return false;
+    }
+    while (done < size) {
+        auto chunk = static_cast<uint32_t>(std::min<size_t>(size - done, 1u << 30));
+        int64_t got = ring->read(fd, data + done, chunk, offset + done);
+        if (got == -EINTR || got == -EAGAIN) {
+            continue;
+        }
+        if (got == -EINVAL || got == -EOPNOTSUPP) {
+            // A kernel without IORING_OP_READ
+            ioUringAvailable = false;
+            return false;
+        }
+        if (got <= 0) {
+            break;
+        }
+        done += static_cast<size_t>(got);
+    }
+    return true;
+}
+
+#else
+
+static bool ioUringUsable() {
+    return false;
+}
+
+static bool ioUringRead(int, char *, size_t, uint64_t, size_t &done) {
+    done = 0;
+    return false;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef MACDEPENDENCY_FILE_READER_H
+#define MACDEPENDENCY_FILE_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+
+// How FileReader gets at a file's bytes.
+//
+//   pread     plain pread(); best for small files and for network file systems
+//   mmap      a read-only mapping, parsed in place; best for large local files
+//   io_uring  reads submitted through an io_uring (Linux), pread() where the
+//             kernel has none or it is not allowed
+//   direct    O_DIRECT (F_NOCACHE on macOS) through an aligned buffer, keeping
+//             large scans out of the page cache
+//
+// Auto picks pread or mmap per file from its size and file system type.
+enum class IoBackend {
+    Auto,
+    Pread,
+    Mmap,
+    IoUring,
+    Direct,
+};
+
+const char *ioBackendName(IoBackend backend);
+// Accepts the names ioBackendName() returns.
+bool parseIoBackend(const std::string &name, IoBackend &backend);
+
+// The backend every FileReader uses from now on; Auto by default.
+// Not thread-safe; set it before reading starts.
+void setIoBackend(IoBackend backend);
+
+// Files opened, reads and bytes read per backend since the start, as a YAML
+// mapping, with the bytes mapped and the number of times a backend could not
+// be used. Backends that were not used are left out.
+void printIoStats(std::ostream &out);
+
+// A file opened for reading through one of the backends. read() may be called
+// from several threads at once.
+class FileReader {
+public:
+    FileReader() = default;
+    ~FileReader();
+
+    FileReader(const FileReader &) = delete;
+    FileReader &operator=(const FileReader &) = delete;
+
+    bool open(const std::string &path);
+
+    uint64_t size() const { return size_; }
+    IoBackend backend() const { return backend_; }
+
+    // The whole file when it is mapped, nullptr otherwise.
+    const char *mapped() const { return mapped_; }
+
+    // Reads `size` bytes at `offset`, fewer where the file ends. Returns the
+    // number of bytes read.
+    size_t read(char *data, size_t size, uint64_t offset);
+
+private:
+    size_t readDirect(char *data, size_t size, uint64_t offset);
+
+    int fd_ = -1;
+    int directFd_ = -1;
+    uint64_t size_ = 0;
+    IoBackend backend_ = IoBackend::Pread;
+    const char *mapped_ = nullptr;
+};
+
+#endif // MACDEPENDENCY_FILE_READER_H
@@ -0,0 +1,24 @@
+#include "file_walker.h"
+
+#include <filesystem>
+#include <system_error>
+
+
+std::vector<std::string> expandPaths(const std::vector<std::string> &paths) {
+    std::vector<std::string> files;
+    for (const auto &path : paths) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(path, error)) {
+            files.push_back(path);
+            continue;
+        }
+        auto options = std::filesystem::directory_options::skip_permission_denied;
+        for (std::filesystem::recursive_directory_iterator it(path, options, error), end; !error && it != end;
+             it.increment(error)) {
+            if (it->is_regular_file(error) && !it->is_symlink(error)) {
+                files.push_back(it->path().string());
+            }
+        }
+    }
+    return files;
+}
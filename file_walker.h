@@ -0,0 +1,13 @@
+#ifndef MACDEPENDENCY_FILE_WALKER_H
+#define MACDEPENDENCY_FILE_WALKER_H
+
+#include <string>
+#include <vector>
+
+
+// Expands directories into the regular files below them, in directory order.
+// Other paths are passed through as they are. Symbolic links inside
+// directories are not followed, so every file is visited once.
+std::vector<std::string> expandPaths(const std::vector<std::string> &paths);
+
+#endif // MACDEPENDENCY_FILE_WALKER_H
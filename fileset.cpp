@@ -0,0 +1,63 @@
+#include "fileset.h"
+
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "task_pool.h"
+
+
+std::vector<MachOInfo> parseFilesetEntries(const std::string &path, const MachOInfo &fileset, TaskPool *pool,
+                                           std::ostream &out) {
+    std::vector<MachOInfo> entries(fileset.fileset_entries.size());
+    if (entries.empty()) {
+        return entries;
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+        out << "Could not open file: " << path << '\n';
+        if (fd >= 0) {
+            close(fd);
+        }
+        return entries;
+    }
+    auto fileSize = static_cast<size_t>(st.st_size);
+    void *mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        out << "Could not map file: " << path << '\n';
+        return entries;
+    }
+
+    // Entries only read their own headers, so they are parsed independently
+    // and their diagnostics put back in entry order afterwards.
+    const auto *data = static_cast<const char *>(mapped);
+    uint64_t sliceEnd = std::min<uint64_t>(fileset.offset + fileset.size, fileSize);
+    std::vector<std::string> diagnostics(entries.size());
+    TaskGroup group(pool);
+    for (size_t i = 0; i < entries.size(); i++) {
+        group.run([&, i]() {
+            const auto &entry = fileset.fileset_entries[i];
+            std::ostringstream entryOut;
+            uint64_t start = fileset.offset + entry.fileoff;
+            if (start >= sliceEnd) {
+                entryOut << "Fileset entry " << entry.entry_id << " lies outside the file\n";
+            } else if (!parseMachOImage(data + start, static_cast<size_t>(sliceEnd - start), start, entries[i],
+                                        entryOut)) {
+                entries[i] = MachOInfo {};
+            }
+            diagnostics[i] = entryOut.str();
+        });
+    }
+    group.wait();
+    munmap(mapped, fileSize);
+
+    for (const auto &text : diagnostics) {
+        out << text;
+    }
+    return entries;
+}
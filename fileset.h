@@ -0,0 +1,19 @@
+#ifndef MACDEPENDENCY_FILESET_H
+#define MACDEPENDENCY_FILESET_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "macho_parser.h"
+
+
+// Parses the embedded header of every LC_FILESET_ENTRY of an MH_FILESET slice
+// of `path`, in place from a read-only mapping of the file, each entry as a
+// task of `pool` (inline without one). Nothing is extracted. The result matches
+// fileset.fileset_entries index for index; entries whose header cannot be
+// parsed have an empty arch, with the reason reported to `out`.
+std::vector<MachOInfo> parseFilesetEntries(const std::string &path, const MachOInfo &fileset, TaskPool *pool,
+                                           std::ostream &out);
+
+#endif // MACDEPENDENCY_FILESET_H
@@ -0,0 +1,66 @@
+#include "load_command_edits.h"
+
+#include "number_parser.h"
+
+
+// Size of a load command with a fixed part followed by a NUL-terminated string
+static int64_t stringCommandSize(const MachOInfo &info, size_t fixedSize, const std::string &string) {
+    uint64_t alignment = info.is_64_bit ? 8 : 4;
+    uint64_t size = fixedSize + string.size() + 1;
+    return static_cast<int64_t>((size + alignment - 1) & ~(alignment - 1));
+}
+
+bool LoadCommandEdits::parseOption(const std::vector<std::string> &args, size_t &i, std::string &error) {
+    const auto &arg = args[i];
+    if (i + 1 >= args.size()) {
+        return false;
+    }
+    const auto &value = args[i + 1];
+    if (arg == "--add-rpath") {
+        addRpaths.push_back(value);
+    } else if (arg == "--change") {
+        auto equals = value.find('=');
+        if (equals == std::string::npos) {
+            error = "Expected --change old=new: " + value;
+        } else {
+            changes.emplace_back(value.substr(0, equals), value.substr(equals + 1));
+        }
+    } else if (arg == "--id") {
+        id = value;
+    } else if (arg == "--need") {
+        uint64_t bytes = 0;
+        if (!parseUnsigned(value, bytes)) {
+            error = "Expected a number for --need: " + value;
+        }
+        extraBytes += bytes;
+    } else {
+        return false;
+    }
+    i++;
+    return true;
+}
+
+bool LoadCommandEdits::empty() const {
+    return addRpaths.empty() && changes.empty() && id.empty() && extraBytes == 0;
+}
+
+int64_t loadCommandGrowth(const MachOInfo &info, const LoadCommandEdits &edits) {
+    int64_t growth = static_cast<int64_t>(edits.extraBytes);
+    for (const auto &rpath : edits.addRpaths) {
+        growth += stringCommandSize(info, sizeof(struct rpath_command), rpath);
+    }
+    for (const auto &change : edits.changes) {
+        for (const auto &dep : info.deps) {
+            if (dep.name == change.first) {
+                growth += stringCommandSize(info, sizeof(struct dylib_command), change.second)
+                          - stringCommandSize(info, sizeof(struct dylib_command), dep.name);
+            }
+        }
+    }
+    // install_name_tool ignores -id for anything but a dylib
+    if (!edits.id.empty() && !info.dylib_id.empty()) {
+        growth += stringCommandSize(info, sizeof(struct dylib_command), edits.id)
+                  - stringCommandSize(info, sizeof(struct dylib_command), info.dylib_id);
+    }
+    return growth;
+}
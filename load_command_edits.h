@@ -0,0 +1,33 @@
+#ifndef MACDEPENDENCY_LOAD_COMMAND_EDITS_H
+#define MACDEPENDENCY_LOAD_COMMAND_EDITS_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "macho_parser.h"
+
+
+// A set of install_name_tool style edits to the load commands of a binary.
+struct LoadCommandEdits {
+    std::vector<std::string> addRpaths;                            // -add_rpath
+    std::vector<std::pair<std::string, std::string>> changes;      // -change old new
+    std::string id;                                                // -id
+    uint64_t extraBytes = 0;                                       // room needed for anything else
+
+    // Parses "--add-rpath <path>", "--change <old>=<new>", "--id <name>" or
+    // "--need <bytes>" at args[i], advancing i past its value. Returns false
+    // if args[i] is not one of them. A malformed value still counts as the
+    // option, and sets `error`.
+    bool parseOption(const std::vector<std::string> &args, size_t &i, std::string &error);
+
+    bool empty() const;
+};
+
+// How many bytes the load commands of a slice grow by when the edits are
+// applied; negative if they shrink. Commands are sized the way ld64 and
+// install_name_tool write them, padded to the pointer size.
+int64_t loadCommandGrowth(const MachOInfo &info, const LoadCommandEdits &edits);
+
+#endif // MACDEPENDENCY_LOAD_COMMAND_EDITS_H
@@ -0,0 +1,258 @@
+#ifndef MACDEPENDENCY_LOAD_COMMAND_TRAITS_H
+#define MACDEPENDENCY_LOAD_COMMAND_TRAITS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mach-o/loader.h>
+
+#include "macho_parser.h"
+#include "simd_kernels.h"
+
+
+// One load command as the walker hands it to a handler: `size` is cmdsize,
+// cut short where the buffer ends, and is at least sizeof the command struct.
+struct LoadCommandView {
+    const char *data;
+    size_t size;
+    uint32_t cmd;
+};
+
+// What the parser knows about a load command, one specialization per command:
+//
+//   Type          the command struct, copied out of the buffer before use
+//   stringFields  offsets of its lc_str fields within Type; the walker checks
+//                 that each string starts inside the command and passes them
+//                 to apply() in this order, bounded by the command
+//   apply()       stores what the command says in a MachOInfo
+//
+// Commands without a specialization are skipped. Handling another command
+// takes nothing but its specialization: the dispatch table below is built from
+// every command that has one.
+template <uint32_t Cmd>
+struct LoadCommandTraits;
+
+template <size_t Count>
+using LoadCommandStrings = std::array<std::string_view, Count>;
+
+struct DylibCommandTraits {
+    using Type = struct dylib_command;
+    static constexpr std::array<size_t, 1> stringFields {offsetof(struct dylib_command, dylib.name)};
+
+    static void apply(const Type &command, const LoadCommandView &view, const LoadCommandStrings<1> &strings,
+                      MachOInfo &info) {
+        info.deps.push_back({std::string(strings[0]), view.cmd, command.dylib.current_version,
+                             command.dylib.compatibility_version});
+    }
+};
+
+template <> struct LoadCommandTraits<LC_LOAD_DYLIB> : DylibCommandTraits {};
+template <> struct LoadCommandTraits<LC_LOAD_WEAK_DYLIB> : DylibCommandTraits {};
+template <> struct LoadCommandTraits<LC_REEXPORT_DYLIB> : DylibCommandTraits {};
+template <> struct LoadCommandTraits<LC_LOAD_UPWARD_DYLIB> : DylibCommandTraits {};
+template <> struct LoadCommandTraits<LC_LAZY_LOAD_DYLIB> : DylibCommandTraits {};
+
+template <>
+struct LoadCommandTraits<LC_ID_DYLIB> {
+    using Type = struct dylib_command;
+    static constexpr std::array<size_t, 1> stringFields {offsetof(struct dylib_command, dylib.name)};
+
+    static void apply(const Type &command, const LoadCommandView &, const LoadCommandStrings<1> &strings,
+                      MachOInfo &info) {
+        info.dylib_id = std::string(strings[0]);
+        info.current_version = command.dylib.current_version;
+        info.compatibility_version = command.dylib.compatibility_version;
+    }
+};
+
+template <>
+struct LoadCommandTraits<LC_RPATH> {
+    using Type = struct rpath_command;
+    static constexpr std::array<size_t, 1> stringFields {offsetof(struct rpath_command, path)};
+
+    static void apply(const Type &, const LoadCommandView &, const LoadCommandStrings<1> &strings,
+                      MachOInfo &info) {
+        info.rpaths.emplace_back(strings[0]);
+    }
+};
+
+template <>
+struct LoadCommandTraits<LC_LINKER_OPTION> {
+    using Type = struct linker_option_command;
+    static constexpr std::array<size_t, 0> stringFields {};
+
+    static void apply(const Type &command, const LoadCommandView &view, const LoadCommandStrings<0> &,
+                      MachOInfo &info) {
+        // NUL-terminated arguments follow the command
+        size_t index = sizeof(Type);
+        std::vector<std::string> arguments;
+        for (uint32_t n = 0; n < command.count && index < view.size; n++) {
+            size_t length = simdKernels().boundedLength(view.data + index, view.size - index);
+            arguments.emplace_back(view.data + index, length);
+            index += length + 1;
+        }
+        info.linker_options.push_back(std::move(arguments));
+    }
+};
+
+template <>
+struct LoadCommandTraits<LC_FILESET_ENTRY> {
+    using Type = struct fileset_entry_command;
+    static constexpr std::array<size_t, 1> stringFields {offsetof(struct fileset_entry_command, entry_id)};
+
+    static void apply(const Type &command, const LoadCommandView &, const LoadCommandStrings<1> &strings,
+                      MachOInfo &info) {
+        info.fileset_entries.push_back({std::string(strings[0]), command.vmaddr, command.fileoff});
+    }
+};
+
+template <bool is64BitSegment>
+struct SegmentCommandTraits {
+    using Type = typename std::conditional<is64BitSegment, struct segment_command_64, struct segment_command>::type;
+    using SectionType = typename std::conditional<is64BitSegment, struct section_64, struct section>::type;
+    static constexpr std::array<size_t, 0> stringFields {};
+
+    static void apply(const Type &segment, const LoadCommandView &view, const LoadCommandStrings<0> &,
+                      MachOInfo &info) {
+        if (info.is_64_bit != is64BitSegment) {
+            // Segment command of the other word size
+            return;
+        }
+        info.segments.push_back({std::string(segment.segname, strnlen(segment.segname, 16)),
+                                 segment.vmaddr, segment.vmsize, segment.fileoff, segment.filesize,
+                                 segment.maxprot, segment.initprot});
+
+        // Section headers follow the segment command
+        size_t maxSections = (view.size - sizeof(Type)) / sizeof(SectionType);
+        for (size_t i = 0; i < segment.nsects && i < maxSections; i++) {
+            SectionType sect {};
+            std::memcpy(&sect, view.data + sizeof(Type) + i * sizeof(SectionType), sizeof(SectionType));
+            info.sections.push_back({std::string(sect.segname, strnlen(sect.segname, 16)),
+                                     std::string(sect.sectname, strnlen(sect.sectname, 16)),
+                                     sect.addr, sect.size, sect.offset, sect.flags});
+        }
+    }
+};
+
+template <> struct LoadCommandTraits<LC_SEGMENT> : SegmentCommandTraits<false> {};
+template <> struct LoadCommandTraits<LC_SEGMENT_64> : SegmentCommandTraits<true> {};
+
+template <>
+struct LoadCommandTraits<LC_SYMTAB> {
+    using Type = struct symtab_command;
+    static constexpr std::array<size_t, 0> stringFields {};
+
+    static void apply(const Type &command, const LoadCommandView &, const LoadCommandStrings<0> &,
+                      MachOInfo &info) {
+        info.symtab_offset = command.symoff;
+        info.symtab_count = command.nsyms;
+        info.strtab_offset = command.stroff;
+        info.strtab_size = command.strsize;
+    }
+};
+
+struct DyldInfoCommandTraits {
+    using Type = struct dyld_info_command;
+    static constexpr std::array<size_t, 0> stringFields {};
+
+    static void apply(const Type &command, const LoadCommandView &, const LoadCommandStrings<0> &,
+                      MachOInfo &info) {
+        info.exports_trie_offset = command.export_off;
+        info.exports_trie_size = command.export_size;
+    }
+};
+
+template <> struct LoadCommandTraits<LC_DYLD_INFO> : DyldInfoCommandTraits {};
+template <> struct LoadCommandTraits<LC_DYLD_INFO_ONLY> : DyldInfoCommandTraits {};
+
+template <>
+struct LoadCommandTraits<LC_DYLD_EXPORTS_TRIE> {
+    using Type = struct linkedit_data_command;
+    static constexpr std::array<size_t, 0> stringFields {};
+
+    static void apply(const Type &command, const LoadCommandView &, const LoadCommandStrings<0> &,
+                      MachOInfo &info) {
+        info.exports_trie_offset = command.dataoff;
+        info.exports_trie_size = command.datasize;
+    }
+};
+
+
+// The walker's side of the registry: the same checks for every command, then
+// the command's apply(). Commands too short for their struct, or with a string
+// starting outside the command, are skipped.
+template <uint32_t Cmd>
+void handleLoadCommand(const LoadCommandView &view, MachOInfo &info) {
+    using Traits = LoadCommandTraits<Cmd>;
+    using Type = typename Traits::Type;
+    if (view.size < sizeof(Type)) {
+        return;
+    }
+    Type command {};
+    std::memcpy(&command, view.data, sizeof(Type));
+
+    LoadCommandStrings<Traits::stringFields.size()> strings;
+    for (size_t i = 0; i < strings.size(); i++) {
+        uint32_t offset = 0;
+        std::memcpy(&offset, view.data + Traits::stringFields[i], sizeof(offset));
+        if (offset >= view.size) {
+            return;
+        }
+        strings[i] = std::string_view(view.data + offset,
+                                      simdKernels().boundedLength(view.data + offset, view.size - offset));
+    }
+    Traits::apply(command, view, strings, info);
+}
+
+using LoadCommandHandler = void (*)(const LoadCommandView &, MachOInfo &);
+
+// Table slots cover the commands there are: the low six bits, and LC_REQ_DYLD.
+constexpr uint32_t kLoadCommandSlotBits = 0x3f;
+constexpr size_t kLoadCommandSlots = 2 * (kLoadCommandSlotBits + 1);
+
+constexpr uint32_t loadCommandOfSlot(size_t slot) {
+    return static_cast<uint32_t>(slot & kLoadCommandSlotBits) | (slot > kLoadCommandSlotBits ? LC_REQ_DYLD : 0);
+}
+
+template <uint32_t Cmd, typename = void>
+struct HasLoadCommandTraits : std::false_type {};
+
+template <uint32_t Cmd>
+struct HasLoadCommandTraits<Cmd, std::void_t<decltype(sizeof(LoadCommandTraits<Cmd>))>> : std::true_type {};
+
+template <uint32_t Cmd>
+constexpr LoadCommandHandler loadCommandHandler() {
+    if constexpr (HasLoadCommandTraits<Cmd>::value) {
+        return &handleLoadCommand<Cmd>;
+    } else {
+        return nullptr;
+    }
+}
+
+template <size_t... Slots>
+constexpr std::array<LoadCommandHandler, kLoadCommandSlots> makeLoadCommandHandlers(std::index_sequence<Slots...>) {
+    return {{loadCommandHandler<loadCommandOfSlot(Slots)>()...}};
+}
+
+// Handler of every command with traits, indexed by slot: dispatch is one
+// indexed, indirect call.
+inline constexpr auto kLoadCommandHandlers = makeLoadCommandHandlers(std::make_index_sequence<kLoadCommandSlots>());
+
+inline void dispatchLoadCommand(const LoadCommandView &view, MachOInfo &info) {
+    if ((view.cmd & ~(LC_REQ_DYLD | kLoadCommandSlotBits)) != 0) {
+        return;
+    }
+    size_t slot = (view.cmd & kLoadCommandSlotBits) + ((view.cmd & LC_REQ_DYLD) ? kLoadCommandSlotBits + 1 : 0);
+    if (auto handler = kLoadCommandHandlers[slot]) {
+        handler(view, info);
+    }
+}
+
+#endif // MACDEPENDENCY_LOAD_COMMAND_TRAITS_H
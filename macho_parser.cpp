@@ -0,0 +1,358 @@
+#include "macho_parser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <type_traits>
+
+#include <mach-o/fat.h>
+#include <mach-o/arch.h>
+
+#include "file_reader.h"
+#include "load_command_traits.h"
+#include "simd_kernels.h"
+#include "task_pool.h"
+#include "text_stub.h"
+
+
+// Bytes read from the start of a file before anything is known about it.
+// wholeFile is set when the file ended before the read did.
+struct ReadAhead {
+    const char *data;
+    size_t size;
+    bool wholeFile;
+    uint64_t fileSize;
+};
+
+static size_t speculativeReadSize = kDefaultSpeculativeReadSize;
+
+template <bool is64BitMachHeader>
+bool parseMachHeader(const char *data, size_t size, uint64_t offset, MachOInfo &machOInfo, std::ostream &out);
+
+bool parseSliceAt(FileReader &file, uint64_t offset, const ReadAhead &ahead, MachOInfo &machOInfo, std::ostream &out);
+
+template <bool is64BitFatArch>
+void parseFatHeaderAndUpdateResult(FileReader &file,
+                                   const ReadAhead &ahead,
+                                   std::vector<MachOInfo> &result,
+                                   std::ostream &out,
+                                   TaskPool *pool);
+
+
+// IMPLEMENTATION BELOW
+
+void setSpeculativeReadSize(size_t size) {
+    // Never less than a fat table with a few slices, or than text stub detection looks at
+    speculativeReadSize = std::max<size_t>(size, 512);
+}
+
+template <bool is64BitMachHeader>
+bool parseMachHeader(const char *data, size_t size, uint64_t offset, MachOInfo &machOInfo, std::ostream &out) {
+    using MachHeaderType = typename std::conditional<is64BitMachHeader, struct mach_header_64, struct mach_header>::type;
+    MachHeaderType mh {};
+    if (size < sizeof(MachHeaderType)) {
+        out << "Truncated Mach-O header\n";
+        return false;
+    }
+    std::memcpy(&mh, data, sizeof(MachHeaderType));
+
+    // Get architecture name
+    const auto arch = NXGetArchInfoFromCpuType(mh.cputype, mh.cpusubtype);
+    if (!arch) {
+        out << "Unable to get architecture name\n";
+        return false;  // break the switch statement
+    }
+
+    machOInfo.arch = arch->name;
+    machOInfo.cputype = mh.cputype;
+    machOInfo.cpusubtype = mh.cpusubtype;
+    machOInfo.filetype = mh.filetype;
+    machOInfo.offset = offset;
+    machOInfo.flags = mh.flags;
+    machOInfo.is_64_bit = is64BitMachHeader;
+    machOInfo.sizeofcmds = mh.sizeofcmds;
+
+    uint32_t ncmds = mh.ncmds;
+    // Never past the end of the buffer, whatever sizeofcmds claims
+    const char *cmds = data + sizeof(MachHeaderType);
+    size_t cmdsSize = std::min<size_t>(mh.sizeofcmds, size - sizeof(MachHeaderType));
+
+    size_t arrIndex = 0;
+    for (uint32_t i = 0; i < ncmds; i++) {
+        if (arrIndex > cmdsSize || arrIndex + sizeof(struct load_command) > cmdsSize) {
+            // Array boundary check
+            break;
+        }
+        auto ptr = cmds + arrIndex;
+        auto lc = reinterpret_cast<const struct load_command *>(ptr);
+        uint32_t cmd = lc->cmd;
+        uint32_t cmdsize = lc->cmdsize;
+
+        // Uniform bounds checks and a table lookup, see load_command_traits.h
+        dispatchLoadCommand({ptr, std::min<size_t>(cmdsize, cmdsSize - arrIndex), cmd}, machOInfo);
+
+        arrIndex += cmdsize;
+    }
+
+    return true;
+}
+
+bool parseSliceAt(FileReader &file, uint64_t offset, const ReadAhead &ahead, MachOInfo &machOInfo, std::ostream &out) {
+    // Parse in place from the read-ahead when it covers the slice's load commands, and
+    // otherwise from a speculative read at the slice, which usually covers them too.
+    const char *data = nullptr;
+    size_t size = 0;
+    bool complete = ahead.wholeFile;
+    std::vector<char> buffer;
+    if (offset < ahead.size) {
+        data = ahead.data + offset;
+        size = ahead.size - offset;
+    } else if (!ahead.wholeFile) {
+        buffer.resize(speculativeReadSize);
+        buffer.resize(file.read(buffer.data(), buffer.size(), offset));
+        complete = buffer.size() < speculativeReadSize;
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+    // Whatever the file does not have reads as zeros, and fails the checks
+    struct mach_header_64 mh {};
+    if (size > 0) {
+        std::memcpy(&mh, data, std::min(size, sizeof(mh)));
+    }
+    bool is64BitMachHeader = mh.magic == MH_MAGIC_64 || mh.magic == MH_CIGAM_64;
+    size_t needed = (is64BitMachHeader ? sizeof(struct mach_header_64) : sizeof(struct mach_header))
+                    + mh.sizeofcmds;
+    if (size < needed && !complete && offset < ahead.fileSize) {
+        // The load commands go on past what was read: one more read for all of them
+        std::vector<char> whole(std::min<uint64_t>(needed, ahead.fileSize - offset));
+        whole.resize(file.read(whole.data(), whole.size(), offset));
+        buffer = std::move(whole);
+        data = buffer.data();
+        size = buffer.size();
+    }
+    if (is64BitMachHeader) {
+        return parseMachHeader<true>(data, size, offset, machOInfo, out);
+    }
+    return parseMachHeader<false>(data, size, offset, machOInfo, out);
+}
+
+template <bool is64BitFatArch>
+void parseFatHeaderAndUpdateResult(FileReader &file,
+                                   const ReadAhead &ahead,
+                                   std::vector<MachOInfo> &result,
+                                   std::ostream &out,
+                                   TaskPool *pool) {
+    using FatArchType = typename std::conditional<is64BitFatArch, struct fat_arch_64, struct fat_arch>::type;
+
+    // Fat binary (universal binary), 32-bit header
+    struct fat_header fh {};
+    std::memcpy(&fh, ahead.data, sizeof(struct fat_header));
+    // Swap byte order, since all fields in the universal header are big-endian.
+    fh.nfat_arch = OSSwapInt32(fh.nfat_arch);
+
+    // The fat table is almost always within the read-ahead
+    const char *table = ahead.data + sizeof(struct fat_header);
+    size_t tableSize = ahead.size - sizeof(struct fat_header);
+    std::vector<char> buffer;
+    uint64_t tableEnd = sizeof(struct fat_header) + static_cast<uint64_t>(fh.nfat_arch) * sizeof(FatArchType);
+    tableEnd = std::min(tableEnd, ahead.fileSize);
+    if (!ahead.wholeFile && sizeof(struct fat_header) + tableSize < tableEnd) {
+        buffer.resize(tableEnd - sizeof(struct fat_header));
+        buffer.resize(file.read(buffer.data(), buffer.size(), sizeof(struct fat_header)));
+        table = buffer.data();
+        tableSize = buffer.size();
+    }
+
+    // Read architecture info
+    std::vector<FatArchType> archs(std::min<size_t>(fh.nfat_arch, tableSize / sizeof(FatArchType)));
+    std::memcpy(archs.data(), table, archs.size() * sizeof(FatArchType));
+    if constexpr(is64BitFatArch) {
+        for (auto &fa : archs) {
+            fa.cputype = OSSwapInt32(fa.cputype);
+            fa.cpusubtype = OSSwapInt32(fa.cpusubtype);
+            fa.offset = OSSwapInt64(fa.offset);
+            fa.size = OSSwapInt64(fa.size);
+        }
+    } else {
+        // struct fat_arch is five 32-bit words, so the table swaps as one array
+        static_assert(sizeof(struct fat_arch) == 5 * sizeof(uint32_t));
+        simdKernels().byteSwap32(reinterpret_cast<uint32_t *>(archs.data()), archs.size() * 5);
+    }
+
+    // Slices are independent, so each one is a task of its own. Results and
+    // diagnostics go back in fat table order once all of them are done.
+    struct Slice {
+        MachOInfo info;
+        bool parsed = false;
+        std::string diagnostics;
+    };
+    std::vector<Slice> slices(archs.size());
+    TaskGroup group(pool);
+    for (size_t i = 0; i < archs.size(); i++) {
+        group.run([&, i]() {
+            const auto &fa = archs[i];
+            std::ostringstream sliceOut;
+            // Get architecture name
+            if (!NXGetArchInfoFromCpuType(fa.cputype, fa.cpusubtype)) {
+                sliceOut << "Unable to get architecture name\n";
+            } else if (parseSliceAt(file, fa.offset, ahead, slices[i].info, sliceOut)) {
+                slices[i].info.size = fa.size;
+                slices[i].parsed = true;
+            }
+            slices[i].diagnostics = sliceOut.str();
+        });
+    }
+    group.wait();
+
+    for (auto &slice : slices) {
+        out << slice.diagnostics;
+        if (slice.parsed) {
+            result.emplace_back(std::move(slice.info));
+        }
+    }
+}
+
+std::vector<MachOInfo> parseMachO(const std::string &filename, std::ostream &out, TaskPool *pool) {
+    // Open Mach-O File
+    FileReader file;
+    if (!file.open(filename)) {
+        out << "Could not open file: " << filename << '\n';
+        return {};
+    }
+
+    std::vector<MachOInfo> result;
+
+    // Thin files span the whole file
+    auto fileSize = file.size();
+
+    // A mapped file is parsed in place. Otherwise one read covers the magic,
+    // the fat table, and the header and load commands of a thin file, unless
+    // they are larger than the read size.
+    std::vector<char> head;
+    ReadAhead ahead {file.mapped(), static_cast<size_t>(fileSize), true, fileSize};
+    if (!ahead.data) {
+        head.resize(speculativeReadSize);
+        head.resize(file.read(head.data(), head.size(), 0));
+        ahead = {head.data(), head.size(), head.size() < speculativeReadSize, fileSize};
+    }
+
+    // Read file header to determine if it's a Mach-O file
+    uint32_t magic = 0;
+    if (ahead.size >= sizeof(magic)) {
+        std::memcpy(&magic, ahead.data, sizeof(magic));
+    }
+
+    // Check the magic number
+    switch (magic) {
+        // Check if it's a fat binary (universal binary)
+        case FAT_MAGIC:
+        case FAT_CIGAM:
+        {
+            // Fat binary (universal binary), 32-bit header
+            constexpr bool is64BitFatArch = false;
+            if (ahead.size >= sizeof(struct fat_header)) {
+                parseFatHeaderAndUpdateResult<is64BitFatArch>(file, ahead, result, out, pool);
+            }
+        } // cases for fat binaries
+            break;
+        case FAT_MAGIC_64:
+        case FAT_CIGAM_64:
+        {
+            // Fat binary (universal binary), 64-bit header
+            constexpr bool is64BitFatArch = true;
+            if (ahead.size >= sizeof(struct fat_header)) {
+                parseFatHeaderAndUpdateResult<is64BitFatArch>(file, ahead, result, out, pool);
+            }
+        } // cases for fat binaries
+            break;
+        case MH_MAGIC:
+        case MH_CIGAM:
+        case MH_MAGIC_64:
+        case MH_CIGAM_64:
+        {
+            // Not a fat binary, only one architecture
+            MachOInfo machOInfo;
+            if (parseSliceAt(file, 0, ahead, machOInfo, out)) {
+                machOInfo.size = fileSize;
+                result.emplace_back(std::move(machOInfo));
+            }
+        } // cases for thin binaries
+            break;
+        default:
+        {
+            // SDKs ship text stubs in place of dylibs
+            if (looksLikeTextStub(ahead.data, std::min<size_t>(ahead.size, 64))) {
+                return parseTextStub(filename, out);
+            }
+            out << "File " << filename << " is not a Mach-O file\n";
+            return {};
+        }
+    }
+    return result;
+}
+
+bool parseMachOImage(const char *data, size_t size, uint64_t offset, MachOInfo &info, std::ostream &out) {
+    uint32_t magic = 0;
+    if (size < sizeof(magic)) {
+        out << "Truncated Mach-O header\n";
+        return false;
+    }
+    std::memcpy(&magic, data, sizeof(magic));
+    switch (magic) {
+        case MH_MAGIC:
+            return parseMachHeader<false>(data, size, offset, info, out);
+        case MH_MAGIC_64:
+            return parseMachHeader<true>(data, size, offset, info, out);
+        default:
+            out << "No Mach-O header at offset " << offset << '\n';
+            return false;
+    }
+}
+
+uint32_t machHeaderSize(const MachOInfo &info) {
+    return info.is_64_bit ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+}
+
+uint64_t headerPadding(const MachOInfo &info) {
+    uint64_t firstContent = UINT64_MAX;
+    for (const auto &section : info.sections) {
+        auto type = section.flags & SECTION_TYPE;
+        if (section.offset == 0 || type == S_ZEROFILL || type == S_GB_ZEROFILL || type == S_THREAD_LOCAL_ZEROFILL) {
+            continue;
+        }
+        firstContent = std::min<uint64_t>(firstContent, section.offset);
+    }
+    if (firstContent == UINT64_MAX) {
+        for (const auto &segment : info.segments) {
+            if (segment.fileoff != 0 && segment.filesize != 0) {
+                firstContent = std::min(firstContent, segment.fileoff);
+            }
+        }
+    }
+    if (firstContent == UINT64_MAX) {
+        firstContent = info.size;
+    }
+    uint64_t commandsEnd = machHeaderSize(info) + info.sizeofcmds;
+    return firstContent > commandsEnd ? firstContent - commandsEnd : 0;
+}
+
+const char *dependencyKindName(uint32_t command) {
+    switch (command) {
+        case LC_LOAD_WEAK_DYLIB:
+            return "weak";
+        case LC_REEXPORT_DYLIB:
+            return "reexport";
+        case LC_LOAD_UPWARD_DYLIB:
+            return "upward";
+        case LC_LAZY_LOAD_DYLIB:
+            return "lazy";
+        default:
+            return "";
+    }
+}
+
+std::string formatVersion(uint32_t version) {
+    return std::to_string(version >> 16) + "." + std::to_string((version >> 8) & 0xff) + "."
+           + std::to_string(version & 0xff);
+}
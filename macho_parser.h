@@ -0,0 +1,114 @@
+#ifndef MACDEPENDENCY_MACHO_PARSER_H
+#define MACDEPENDENCY_MACHO_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <mach-o/loader.h>
+
+class TaskPool;
+
+
+// A dylib referenced by one of the LC_*_DYLIB load commands.
+struct DylibReference {
+    std::string name;
+    uint32_t command;  // LC_LOAD_DYLIB, LC_LOAD_WEAK_DYLIB, LC_REEXPORT_DYLIB, ...
+    uint32_t currentVersion;        // versions of the dylib the consumer was linked against
+    uint32_t compatibilityVersion;
+};
+
+struct SegmentInfo {
+    std::string name;
+    uint64_t vmaddr;
+    uint64_t vmsize;
+    uint64_t fileoff;   // relative to the slice
+    uint64_t filesize;
+    vm_prot_t maxprot;
+    vm_prot_t initprot;
+};
+
+struct SectionInfo {
+    std::string segname;
+    std::string sectname;
+    uint64_t addr;
+    uint64_t size;
+    uint32_t offset;    // relative to the slice, 0 for zero-fill sections
+    uint32_t flags;
+};
+
+// An image packed into an MH_FILESET (kernel collection) by LC_FILESET_ENTRY.
+struct FilesetEntry {
+    std::string entry_id;  // e.g. "com.apple.kernel" or a kext bundle identifier
+    uint64_t vmaddr;
+    uint64_t fileoff;      // of the entry's mach_header, relative to the slice
+};
+
+struct MachOInfo {
+    std::string arch;
+    cpu_type_t cputype = 0;
+    cpu_subtype_t cpusubtype = 0;
+    uint32_t filetype = 0;
+    uint64_t offset = 0;  // where the slice starts in the file
+    uint64_t size = 0;    // and how many bytes it spans
+    uint32_t flags = 0;   // mach_header flags (MH_TWOLEVEL, ...)
+    bool is_64_bit = false;
+    // Where the exported symbols are, as file offsets relative to the slice
+    uint32_t exports_trie_offset = 0;  // LC_DYLD_INFO(_ONLY) or LC_DYLD_EXPORTS_TRIE
+    uint32_t exports_trie_size = 0;
+    uint32_t symtab_offset = 0;        // LC_SYMTAB
+    uint32_t symtab_count = 0;
+    uint32_t strtab_offset = 0;
+    uint32_t strtab_size = 0;
+    uint32_t sizeofcmds = 0;
+    std::vector<SegmentInfo> segments;
+    std::vector<SectionInfo> sections;
+    std::string dylib_id;
+    uint32_t current_version = 0;        // from LC_ID_DYLIB
+    uint32_t compatibility_version = 0;
+    std::vector<DylibReference> deps;
+    std::vector<std::string> rpaths;
+    std::vector<std::vector<std::string>> linker_options;  // LC_LINKER_OPTION, e.g. {"-framework", "Foundation"}
+    std::vector<FilesetEntry> fileset_entries;
+    bool text_stub = false;            // parsed from a .tbd rather than a Mach-O file
+    std::vector<std::string> exports;  // symbols a text stub exports; Mach-O files have their trie instead
+};
+
+// Parses every architecture of a thin or universal Mach-O file.
+// Problems are reported to `out`; an unreadable file gives an empty result.
+// With a pool, the slices of a universal file are parsed as concurrent tasks;
+// results and diagnostics still come in fat table order.
+std::vector<MachOInfo> parseMachO(const std::string &filename, std::ostream &out, TaskPool *pool = nullptr);
+
+// parseMachO() starts with a single read of this many bytes, which for most
+// files covers the fat table and the header and load commands of a thin file,
+// and reads this much at each slice of a universal file. Another read happens
+// only when the load commands go on past it. Not thread-safe; set it before
+// parsing starts.
+constexpr size_t kDefaultSpeculativeReadSize = 32 * 1024;
+void setSpeculativeReadSize(size_t size);
+
+// Parses a thin Mach-O image that is already in memory, such as an entry of a
+// mapped kernel collection. `size` bounds everything read; `offset` is where
+// the image starts in its file and ends up in info.offset. info.size is left
+// alone, since a header does not say how far its image extends.
+bool parseMachOImage(const char *data, size_t size, uint64_t offset, MachOInfo &info, std::ostream &out);
+
+// Size of the mach_header (or mach_header_64) in front of the load commands.
+uint32_t machHeaderSize(const MachOInfo &info);
+
+// Free bytes between the end of the load commands and the first section's
+// (or, without sections, the first mapped segment's) file contents. This is
+// the room install_name_tool has for growing the load commands.
+uint64_t headerPadding(const MachOInfo &info);
+
+// Short description of how a dependency is loaded ("weak", "reexport", ...),
+// or an empty string for a plain LC_LOAD_DYLIB.
+const char *dependencyKindName(uint32_t command);
+
+// Packed dylib version (xxxx.yy.zz) as "X.Y.Z".
+std::string formatVersion(uint32_t version);
+
+#endif // MACDEPENDENCY_MACHO_PARSER_H
@@ -1,12 +1,33 @@
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
-#include <type_traits>
 
-#include <mach-o/loader.h>
-#include <mach-o/fat.h>
-#include <mach-o/arch.h>
+#include <unistd.h>
+
+#include "autolink.h"
+#include "bundle_orphans.h"
+#include "closure_checks.h"
+#include "code_signer.h"
+#include "content_hash.h"
+#include "dlopen_scan.h"
+#include "dyld_resolver.h"
+#include "fat_tools.h"
+#include "file_walker.h"
+#include "file_reader.h"
+#include "fileset.h"
+#include "load_command_edits.h"
+#include "macho_parser.h"
+#include "number_parser.h"
+#include "output_pipeline.h"
+#include "parallel.h"
+#include "record_cache.h"
+#include "scan_plan.h"
+#include "task_pool.h"
 
 
 // ANSI escape codes for text formatting
@@ -16,248 +37,1013 @@
 #define ANSI_COLOR_RESET "\x1b[0m"
 
 
-struct MachOInfo {
-    std::string arch;
-    std::string dylib_id;
-    std::vector<std::string> deps;
-    std::vector<std::string> rpaths;
+// Options shared by the subcommands that resolve closures
+struct ResolveOptions {
+    DyldEnvironment environment;
+    std::string executablePath;
+    std::string cachePath;
+    std::vector<std::string> sysroots;
+    PathMapper mapper;  // --map rules
+    unsigned jobs = defaultJobCount();
+    bool stats = false;
+    std::vector<std::string> flags;  // command-specific flags that were given
+    std::vector<std::string> files;
 };
 
-void printInformation(const std::string &name);
+void printUsage(const char *program);
+bool parseResolveOptions(const char *program, const std::vector<std::string> &args, ResolveOptions &options,
+                         const std::vector<std::string> &commandFlags = {});
+bool applyIoBackend(const std::string &name);
+bool parseNumberOption(const std::string &option, const std::string &value, uint64_t &number);
+bool parseJobsOption(const std::string &option, const std::string &value, unsigned &jobs);
+bool applyReadSize(const std::string &value);
+void saveCache(RecordCache &cache, const std::string &path);
+std::vector<PathMapper> pathMappers(const ResolveOptions &options);
+void printSysroot(const PathMapper &mapper, std::ostream &out);
 
-template <bool is64BitMachHeader>
-bool parseMachHeaderAndUpdateResult(std::ifstream &file,
-                                    std::ifstream::pos_type pos,
-                                    std::vector<MachOInfo> &result);
+void printInformation(const std::string &name, const std::vector<MachOInfo> &result, TaskPool *pool,
+                      bool dlopenScan, std::ostream &out);
+void printClosures(const std::string &name, const std::vector<Closure> &closures, std::ostream &out);
+void printCollisions(const std::string &name, const Closure &closure,
+                     const std::vector<InstallNameCollision> &collisions, std::ostream &out);
+void printVersionMismatches(const std::string &name, const Closure &closure, std::ostream &out);
+bool printPadding(const std::string &name, const LoadCommandEdits &edits, std::ostream &out);
+void printAutolinkLibraries(const std::vector<AutolinkLibrary> &libraries, std::ostream &out);
+void printDuplicateSymbols(const std::string &name, const Closure &closure,
+                           const std::vector<DuplicateSymbol> &duplicates,
+                           const std::vector<size_t> &unreadable, std::ostream &out);
+void printFootprint(const std::string &name, const Closure &closure, const ClosureFootprint &footprint,
+                    std::ostream &out);
+void printFingerprint(const std::string &name, const Closure &closure, const Sha256Digest &fingerprint,
+                      const std::vector<size_t> &unreadable, std::ostream &out);
+void printOrphans(const std::string &bundle, const std::vector<BundleFile> &files, const OrphanReport &report,
+                  std::ostream &out);
 
-template <bool is64BitFatArch>
-void parseFatHeaderAndUpdateResult(std::ifstream &file,
-                                   std::vector<MachOInfo> &result);
+int listCommand(const char *program, const std::vector<std::string> &args);
+int resolveCommand(const char *program, const std::vector<std::string> &args);
+int collisionsCommand(const char *program, const std::vector<std::string> &args);
+int versionsCommand(const char *program, const std::vector<std::string> &args);
+int duplicatesCommand(const char *program, const std::vector<std::string> &args);
+int footprintCommand(const char *program, const std::vector<std::string> &args);
+int fingerprintCommand(const char *program, const std::vector<std::string> &args);
+int orphansCommand(const char *program, const std::vector<std::string> &args);
+int paddingCommand(const char *program, const std::vector<std::string> &args);
+int thinCommand(const char *program, const std::vector<std::string> &args);
+int mergeArchesCommand(const char *program, const std::vector<std::string> &args);
+int signCommand(const char *program, const std::vector<std::string> &args);
+int autolinkCommand(const char *program, const std::vector<std::string> &args);
 
-std::vector<MachOInfo> parseMachO(const std::string &filename);
+struct Subcommand {
+    const char *name;
+    int (*run)(const char *program, const std::vector<std::string> &args);
+    const char *usage;
+};
+
+#define RESOLVE_OPTIONS_USAGE "[-j <jobs>] [--env NAME=VALUE] [--inherit-env] [--executable-path <path>]" \
+                              " [--sysroot <dir>] [--map <prefix>=<dir>] [--cache <file>]" \
+                              " [--read-size <bytes>] [--io-backend <backend>] [--stats] [--]"
+
+static const Subcommand kSubcommands[] = {
+    {"resolve", resolveCommand, RESOLVE_OPTIONS_USAGE " <mach-o> [<mach-o> ...]"},
+    {"collisions", collisionsCommand, RESOLVE_OPTIONS_USAGE " <mach-o> [<mach-o> ...]"},
+    {"versions", versionsCommand, RESOLVE_OPTIONS_USAGE " <mach-o> [<mach-o> ...]"},
+    {"duplicates", duplicatesCommand, RESOLVE_OPTIONS_USAGE " [--flat-only] <mach-o> [<mach-o> ...]"},
+    {"footprint", footprintCommand, RESOLVE_OPTIONS_USAGE " <mach-o> [<mach-o> ...]"},
+    {"fingerprint", fingerprintCommand, RESOLVE_OPTIONS_USAGE " <mach-o> [<mach-o> ...]"},
+    {"orphans", orphansCommand, RESOLVE_OPTIONS_USAGE " <bundle> [<bundle> ...]"},
+    {"padding", paddingCommand, "[-j <jobs>] [--add-rpath <path>] [--change <old>=<new>] [--id <name>]"
+                                " [--need <bytes>] <mach-o> [<mach-o> ...]"},
+    {"thin", thinCommand, "[-j <jobs>] --arch <arch> [-o <output>] <mach-o|directory> [...]"},
+    {"merge-arches", mergeArchesCommand, "-o <output> <mach-o> <mach-o> [...]"},
+    {"autolink", autolinkCommand, "[-j <jobs>] [-L <dir>] [-F <dir>] <object|directory> [...]"},
+    {"sign", signCommand, "[-j <jobs>] [--identifier <id>] [-o <output>] <mach-o> [...]"},
+};
 
 
 // IMPLEMENTATION BELOW
 
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        std::cout << "Usage: " << argv[0] << " <mach-o> [<mach-o> ...]\n";
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty()) {
+        for (const auto &subcommand : kSubcommands) {
+            if (args[0] == subcommand.name) {
+                args.erase(args.begin());
+                return subcommand.run(argv[0], args);
+            }
+        }
+    }
+    return listCommand(argv[0], args);
+}
+
+void printUsage(const char *program) {
+    std::cout << "Usage: " << program << " [-j <jobs>] [--unordered] [--cache <file>] [--read-size <bytes>]"
+              << " [--io-backend <backend>] [--stats] [--dlopen-scan] [--verify] <mach-o|directory> [...]\n"
+              << "         (with --cache, files rewritten in place below an unchanged directory are listed\n"
+              << "          as cached until a run with --verify)\n";
+    for (const auto &subcommand : kSubcommands) {
+        std::cout << "       " << program << ' ' << subcommand.name << ' ' << subcommand.usage << '\n';
+    }
+}
+
+// Anything after "--" is a file, so names that start with a dash can still be given.
+bool parseResolveOptions(const char *program, const std::vector<std::string> &args, ResolveOptions &options,
+                         const std::vector<std::string> &commandFlags) {
+    bool endOfOptions = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto &arg = args[i];
+        if (endOfOptions) {
+            options.files.push_back(arg);
+        } else if (arg == "--") {
+            endOfOptions = true;
+        } else if (arg == "--env" && i + 1 < args.size()) {
+            if (!options.environment.set(args[++i])) {
+                std::cerr << "Unknown dyld variable: " << args[i] << '\n';
+                return false;
+            }
+        } else if (arg == "--inherit-env") {
+            options.environment.inheritProcessEnvironment();
+        } else if (arg == "--executable-path" && i + 1 < args.size()) {
+            options.executablePath = args[++i];
+        } else if (arg == "--cache" && i + 1 < args.size()) {
+            options.cachePath = args[++i];
+        } else if (arg == "--sysroot" && i + 1 < args.size()) {
+            options.sysroots.push_back(args[++i]);
+        } else if (arg == "--map" && i + 1 < args.size()) {
+            if (!options.mapper.parseRule(args[++i])) {
+                std::cerr << "Expected --map prefix=dir: " << args[i] << '\n';
+                return false;
+            }
+        } else if ((arg == "-j" || arg == "--jobs") && i + 1 < args.size()) {
+            if (!parseJobsOption(arg, args[++i], options.jobs)) {
+                return false;
+            }
+        } else if (arg == "--read-size" && i + 1 < args.size()) {
+            if (!applyReadSize(args[++i])) {
+                return false;
+            }
+        } else if (arg == "--io-backend" && i + 1 < args.size()) {
+            if (!applyIoBackend(args[++i])) {
+                return false;
+            }
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (std::find(commandFlags.begin(), commandFlags.end(), arg) != commandFlags.end()) {
+            options.flags.push_back(arg);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << '\n';
+            printUsage(program);
+            return false;
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+    return true;
+}
+
+// One mapper per --sysroot, so the same roots are resolved against each of
+// them in turn, and a single one with just the --map rules otherwise.
+std::vector<PathMapper> pathMappers(const ResolveOptions &options) {
+    if (options.sysroots.empty()) {
+        return {options.mapper};
+    }
+    std::vector<PathMapper> mappers;
+    for (const auto &sysroot : options.sysroots) {
+        mappers.push_back(options.mapper);
+        mappers.back().setSysroot(sysroot);
+    }
+    return mappers;
+}
+
+bool parseNumberOption(const std::string &option, const std::string &value, uint64_t &number) {
+    if (!parseUnsigned(value, number)) {
+        std::cerr << "Expected a number for " << option << ": " << value << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool parseJobsOption(const std::string &option, const std::string &value, unsigned &jobs) {
+    uint64_t number = 0;
+    if (!parseNumberOption(option, value, number)) {
+        return false;
+    }
+    if (number == 0) {
+        std::cerr << "Expected at least one job for " << option << '\n';
+        return false;
+    }
+    if (number > UINT_MAX) {
+        std::cerr << "Too many jobs for " << option << ": " << value << '\n';
+        return false;
+    }
+    jobs = static_cast<unsigned>(number);
+    return true;
+}
+
+bool applyReadSize(const std::string &value) {
+    uint64_t size = 0;
+    if (!parseNumberOption("--read-size", value, size) || size > SIZE_MAX) {
+        return false;
+    }
+    setSpeculativeReadSize(static_cast<size_t>(size));
+    return true;
+}
+
+bool applyIoBackend(const std::string &name) {
+    IoBackend backend;
+    if (!parseIoBackend(name, backend)) {
+        std::cerr << "Unknown I/O backend: " << name << " (auto, pread, mmap, io_uring or direct)\n";
+        return false;
+    }
+    setIoBackend(backend);
+    return true;
+}
+
+// A cache that cannot be written only costs the next run its speed.
+void saveCache(RecordCache &cache, const std::string &path) {
+    if (!cache.save()) {
+        std::cerr << "Could not write cache " << path << '\n';
+    }
+}
+
+int listCommand(const char *program, const std::vector<std::string> &args) {
+    unsigned jobs = defaultJobCount();
+    bool preserveOrder = true;
+    bool stats = false;
+    bool dlopenScan = false;
+    bool verify = false;
+    std::string cachePath;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto &arg = args[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < args.size()) {
+            if (!parseJobsOption(arg, args[++i], jobs)) {
+                return 1;
+            }
+        } else if (arg == "--unordered") {
+            preserveOrder = false;
+        } else if (arg == "--cache" && i + 1 < args.size()) {
+            cachePath = args[++i];
+        } else if (arg == "--read-size" && i + 1 < args.size()) {
+            if (!applyReadSize(args[++i])) {
+                return 1;
+            }
+        } else if (arg == "--io-backend" && i + 1 < args.size()) {
+            if (!applyIoBackend(args[++i])) {
+                return 1;
+            }
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--dlopen-scan") {
+            dlopenScan = true;
+        } else if (arg == "--verify") {
+            verify = true;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        printUsage(program);
         return 1;
     }
-    for (int i = 1; i < argc; i++) {
-        printInformation(argv[i]);
-        std::cout << '\n';
+
+    // Files found in directories are listed only if they are Mach-O files or text stubs.
+    // Directories that did not change since the cache was saved are not read again.
+    RecordCache cache(cachePath, std::cerr);
+    std::vector<std::string> files;
+    std::vector<bool> walked;
+    for (const auto &path : paths) {
+        for (auto &file : cache.walk({path}, verify)) {
+            walked.push_back(file != path);
+            files.push_back(std::move(file));
+        }
     }
 
+    // Every worker formats into its own buffer; a single writer thread owns stdout.
+    // Large files start first and small ones go in batches. Files too large for one
+    // thread, such as kernel collections or huge universal binaries, get their
+    // slices and fileset entries parsed as tasks of the same pool.
+    OutputPipeline pipeline(STDOUT_FILENO, preserveOrder);
+    TaskPool pool(jobs);
+    TaskGroup group(&pool);
+    auto tasks = planScan(scanFileSizes(files, jobs, &cache), jobs);
+    for (const auto &task : tasks) {
+        group.run([&]() {
+            TaskPool *subtasks = task.split ? &pool : nullptr;
+            for (auto i : task.files) {
+                std::ostringstream out;
+                auto result = parseMachOCached(files[i], &cache, out, subtasks);
+                if (!result.empty() || !walked[i]) {
+                    printInformation(files[i], result, subtasks, dlopenScan, out);
+                    out << '\n';
+                    pipeline.publish(i, out.str());
+                } else {
+                    pipeline.publish(i, std::string());
+                }
+            }
+        });
+    }
+    group.wait();
+    if (!pipeline.close()) {
+        std::cerr << "Failed to write output\n";
+        return 1;
+    }
+    saveCache(cache, cachePath);
+    if (stats) {
+        printIoStats(std::cerr);
+    }
     return 0;
 }
 
-void printInformation(const std::string &name) {
-    auto result = parseMachO(name);
-    std::cout << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
-    std::cout << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  info: " << ANSI_COLOR_RESET << '\n';
-    for (const auto &item : result) {
-        std::cout << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  - arch: " << ANSI_COLOR_RESET << item.arch << '\n';
-        if (!item.dylib_id.empty()) {
-            std::cout << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    dylib_id: " << ANSI_COLOR_RESET
-                      << item.dylib_id << '\n';
+int resolveCommand(const char *program, const std::vector<std::string> &args) {
+    ResolveOptions options;
+    if (!parseResolveOptions(program, args, options)) {
+        return 1;
+    }
+    if (options.files.empty()) {
+        printUsage(program);
+        return 1;
+    }
+
+    // One resolver (per sysroot) for all roots, so shared libraries are parsed and resolved once.
+    RecordCache cache(options.cachePath, std::cerr);
+    for (auto &mapper : pathMappers(options)) {
+        printSysroot(mapper, std::cout);
+        DyldResolver resolver(options.environment, &cache, std::move(mapper));
+        for (const auto &file : options.files) {
+            printClosures(file, resolver.resolveClosures(file, options.executablePath), std::cout);
+            std::cout << '\n';
         }
-        std::cout << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    deps: " << ANSI_COLOR_RESET << '\n';
-        for (const auto &dep : item.deps) {
-            std::cout << "    - " << dep << '\n';
+    }
+    saveCache(cache, options.cachePath);
+    if (options.stats) {
+        printIoStats(std::cerr);
+    }
+    return 0;
+}
+
+// Exits with 2 when any closure has a collision, so builds can fail on it.
+int collisionsCommand(const char *program, const std::vector<std::string> &args) {
+    ResolveOptions options;
+    if (!parseResolveOptions(program, args, options)) {
+        return 1;
+    }
+    if (options.files.empty()) {
+        printUsage(program);
+        return 1;
+    }
+
+    bool found = false;
+    RecordCache cache(options.cachePath, std::cerr);
+    SliceHashCache hashes(&cache);
+    for (auto &mapper : pathMappers(options)) {
+        printSysroot(mapper, std::cout);
+        DyldResolver resolver(options.environment, &cache, std::move(mapper));
+        for (const auto &file : options.files) {
+            for (const auto &closure : resolver.resolveClosures(file, options.executablePath)) {
+                auto collisions = findInstallNameCollisions(closure, hashes);
+                if (!collisions.empty()) {
+                    printCollisions(file, closure, collisions, std::cout);
+                    found = true;
+                }
+            }
         }
-        std::cout << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    rpaths: " << ANSI_COLOR_RESET << '\n';
-        for (const auto &rpath : item.rpaths) {
-            std::cout << "    - " << rpath << '\n';
+    }
+    saveCache(cache, options.cachePath);
+    if (options.stats) {
+        printIoStats(std::cerr);
+    }
+    return found ? 2 : 0;
+}
+
+// Exits with 2 when dyld would refuse any resolved dependency.
+int versionsCommand(const char *program, const std::vector<std::string> &args) {
+    ResolveOptions options;
+    if (!parseResolveOptions(program, args, options)) {
+        return 1;
+    }
+    if (options.files.empty()) {
+        printUsage(program);
+        return 1;
+    }
+
+    bool found = false;
+    RecordCache cache(options.cachePath, std::cerr);
+    for (auto &mapper : pathMappers(options)) {
+        printSysroot(mapper, std::cout);
+        DyldResolver resolver(options.environment, &cache, std::move(mapper));
+        for (const auto &file : options.files) {
+            for (const auto &closure : resolver.resolveClosures(file, options.executablePath)) {
+                auto mismatch = std::any_of(closure.edges.begin(), closure.edges.end(), [](const ClosureEdge &edge) {
+                    return edge.incompatibleVersion;
+                });
+                if (mismatch) {
+                    printVersionMismatches(file, closure, std::cout);
+                    found = true;
+                }
+            }
         }
     }
+    saveCache(cache, options.cachePath);
+    if (options.stats) {
+        printIoStats(std::cerr);
+    }
+    return found ? 2 : 0;
 }
 
-template <bool is64BitMachHeader>
-bool parseMachHeaderAndUpdateResult(std::ifstream &file,
-                                    std::ifstream::pos_type pos,
-                                    std::vector<MachOInfo> &result) {
-    using MachHeaderType = typename std::conditional<is64BitMachHeader, struct mach_header_64, struct mach_header>::type;
-    MachHeaderType mh {};
-    file.seekg(pos);
-    file.read(reinterpret_cast<char*>(&mh), sizeof(MachHeaderType));
+// Exits with 2 when any reported closure has duplicate exports.
+int duplicatesCommand(const char *program, const std::vector<std::string> &args) {
+    ResolveOptions options;
+    if (!parseResolveOptions(program, args, options, {"--flat-only"})) {
+        return 1;
+    }
+    bool flatOnly = !options.flags.empty();
+    if (options.files.empty()) {
+        printUsage(program);
+        return 1;
+    }
 
-    // Get architecture name
-    const auto arch = NXGetArchInfoFromCpuType(mh.cputype, mh.cpusubtype);
-    if (!arch) {
-        std::cout << "Unable to get architecture name\n";
-        return false;  // break the switch statement
+    bool found = false;
+    RecordCache cache(options.cachePath, std::cerr);
+    for (auto &mapper : pathMappers(options)) {
+        printSysroot(mapper, std::cout);
+        DyldResolver resolver(options.environment, &cache, std::move(mapper));
+        for (const auto &file : options.files) {
+            for (const auto &closure : resolver.resolveClosures(file, options.executablePath)) {
+                auto flat = std::any_of(closure.images.begin(), closure.images.end(),
+                                        [](const ClosureImage &image) { return !(image.info.flags & MH_TWOLEVEL); });
+                if (flatOnly && !flat) {
+                    continue;
+                }
+                std::vector<size_t> unreadable;
+                auto duplicates = findDuplicateSymbols(closure, options.jobs, unreadable);
+                printDuplicateSymbols(file, closure, duplicates, unreadable, std::cout);
+                found = found || !duplicates.empty();
+            }
+        }
+    }
+    saveCache(cache, options.cachePath);
+    if (options.stats) {
+        printIoStats(std::cerr);
     }
+    return found ? 2 : 0;
+}
 
-    MachOInfo machOInfo;
-    machOInfo.arch = arch->name;
+int footprintCommand(const char *program, const std::vector<std::string> &args) {
+    ResolveOptions options;
+    if (!parseResolveOptions(program, args, options)) {
+        return 1;
+    }
+    if (options.files.empty()) {
+        printUsage(program);
+        return 1;
+    }
 
-    uint32_t ncmds = mh.ncmds;
-    uint32_t sizeofcmds = mh.sizeofcmds;
+    // Images shared by several roots, like the system libraries, are added up once.
+    FootprintCache footprints;
+    RecordCache cache(options.cachePath, std::cerr);
+    for (auto &mapper : pathMappers(options)) {
+        printSysroot(mapper, std::cout);
+        DyldResolver resolver(options.environment, &cache, std::move(mapper));
+        for (const auto &file : options.files) {
+            for (const auto &closure : resolver.resolveClosures(file, options.executablePath)) {
+                printFootprint(file, closure, closureFootprint(closure, footprints), std::cout);
+            }
+        }
+    }
+    saveCache(cache, options.cachePath);
+    if (options.stats) {
+        printIoStats(std::cerr);
+    }
+    return 0;
+}
 
-    std::vector<char> cmds(sizeofcmds);
-    file.read(cmds.data(), sizeofcmds);
+// Exits with 1 when an image could not be read, since its fingerprint cannot
+// tell whether that image changed.
+int fingerprintCommand(const char *program, const std::vector<std::string> &args) {
+    ResolveOptions options;
+    if (!parseResolveOptions(program, args, options)) {
+        return 1;
+    }
+    if (options.files.empty()) {
+        printUsage(program);
+        return 1;
+    }
 
-    size_t arrIndex = 0;
-    for (uint32_t i = 0; i < ncmds; i++) {
-        if (arrIndex > cmds.size() || arrIndex + sizeof(struct load_command) > cmds.size()) {
-            // Array boundary check
-            break;
+    // Content hashes come from the cache while their files are unchanged
+    bool failed = false;
+    RecordCache cache(options.cachePath, std::cerr);
+    SliceHashCache hashes(&cache);
+    for (auto &mapper : pathMappers(options)) {
+        printSysroot(mapper, std::cout);
+        DyldResolver resolver(options.environment, &cache, std::move(mapper));
+        for (const auto &file : options.files) {
+            for (const auto &closure : resolver.resolveClosures(file, options.executablePath)) {
+                std::vector<size_t> unreadable;
+                auto fingerprint = closureFingerprint(closure, hashes, unreadable);
+                printFingerprint(file, closure, fingerprint, unreadable, std::cout);
+                failed = failed || !unreadable.empty();
+            }
         }
-        auto ptr = &cmds[arrIndex];
-        auto lc = reinterpret_cast<struct load_command *>(ptr);
-        uint32_t cmd = lc->cmd;
-        uint32_t cmdsize = lc->cmdsize;
+    }
+    saveCache(cache, options.cachePath);
+    if (options.stats) {
+        printIoStats(std::cerr);
+    }
+    return failed ? 1 : 0;
+}
 
-        switch (cmd) {
-            case LC_LOAD_DYLIB:
-            case LC_LOAD_WEAK_DYLIB:
-            {
-                auto cmd_struct = reinterpret_cast<struct dylib_command *>(ptr);
-                if (arrIndex + cmd_struct->dylib.name.offset >= cmds.size()) {
-                    // Array boundary check
-                    break;
-                }
-                auto name = reinterpret_cast<char *>(ptr) + cmd_struct->dylib.name.offset;
-                machOInfo.deps.emplace_back(name);
+// Exits with 2 when any bundle has Mach-O files that nothing loads.
+int orphansCommand(const char *program, const std::vector<std::string> &args) {
+    ResolveOptions options;
+    if (!parseResolveOptions(program, args, options)) {
+        return 1;
+    }
+    if (options.files.empty()) {
+        printUsage(program);
+        return 1;
+    }
+
+    // Every bundle is walked and parsed once, in parallel; the resolvers get the parse results.
+    RecordCache cache(options.cachePath, std::cerr);
+    std::vector<std::vector<BundleFile>> bundles;
+    for (const auto &bundle : options.files) {
+        bundles.push_back(scanBundle(bundle, &cache, options.jobs));
+    }
+    bool found = false;
+    for (auto &mapper : pathMappers(options)) {
+        printSysroot(mapper, std::cout);
+        DyldResolver resolver(options.environment, &cache, std::move(mapper));
+        for (size_t i = 0; i < bundles.size(); i++) {
+            auto report = findOrphans(options.files[i], bundles[i], resolver, options.executablePath);
+            printOrphans(options.files[i], bundles[i], report, std::cout);
+            found = found || !report.orphans.empty();
+        }
+    }
+    saveCache(cache, options.cachePath);
+    if (options.stats) {
+        printIoStats(std::cerr);
+    }
+    return found ? 2 : 0;
+}
+
+// Exits with 2 when any slice lacks the room for the requested edits.
+int paddingCommand(const char *program, const std::vector<std::string> &args) {
+    unsigned jobs = defaultJobCount();
+    LoadCommandEdits edits;
+    std::string error;
+    std::vector<std::string> files;
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto &arg = args[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < args.size()) {
+            if (!parseJobsOption(arg, args[++i], jobs)) {
+                return 1;
             }
-                break;
-            case LC_RPATH:
-            {
-                auto cmd_struct = reinterpret_cast<struct rpath_command *>(ptr);
-                if (arrIndex + cmd_struct->path.offset >= cmds.size()) {
-                    // Array boundary check
-                    break;
-                }
-                auto rpath = reinterpret_cast<char *>(ptr) + cmd_struct->path.offset;
-                machOInfo.rpaths.emplace_back(rpath);
+        } else if (edits.parseOption(args, i, error)) {
+            if (!error.empty()) {
+                std::cerr << error << '\n';
+                return 1;
             }
-                break;
-            case LC_ID_DYLIB:
-            {
-                auto cmd_struct = reinterpret_cast<struct dylib_command *>(ptr);
-                if (arrIndex + cmd_struct->dylib.name.offset >= cmds.size()) {
-                    // Array boundary check
-                    break;
-                }
-                auto name = reinterpret_cast<char *>(ptr) + cmd_struct->dylib.name.offset;
-                machOInfo.dylib_id = name;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        printUsage(program);
+        return 1;
+    }
+
+    std::atomic<bool> insufficient {false};
+    OutputPipeline pipeline(STDOUT_FILENO, true);
+    parallelFor(files.size(), jobs, [&](size_t i) {
+        std::ostringstream out;
+        if (!printPadding(files[i], edits, out)) {
+            insufficient = true;
+        }
+        out << '\n';
+        pipeline.publish(i, out.str());
+    });
+    if (!pipeline.close()) {
+        std::cerr << "Failed to write output\n";
+        return 1;
+    }
+    return insufficient ? 2 : 0;
+}
+
+// Without -o, files are thinned in place and directories are walked;
+// universal binaries without the requested slice are left alone.
+int thinCommand(const char *program, const std::vector<std::string> &args) {
+    unsigned jobs = defaultJobCount();
+    std::string arch;
+    std::string output;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto &arg = args[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < args.size()) {
+            if (!parseJobsOption(arg, args[++i], jobs)) {
+                return 1;
             }
+        } else if (arg == "--arch" && i + 1 < args.size()) {
+            arch = args[++i];
+        } else if (arg == "-o" && i + 1 < args.size()) {
+            output = args[++i];
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (arch.empty() || paths.empty() || (!output.empty() && paths.size() != 1)) {
+        printUsage(program);
+        return 1;
+    }
+
+    auto files = output.empty() ? expandPaths(paths) : paths;
+    std::atomic<bool> failed {false};
+    OutputPipeline pipeline(STDOUT_FILENO, true);
+    parallelFor(files.size(), jobs, [&](size_t i) {
+        std::string error;
+        std::string line;
+        switch (thinFile(files[i], output, arch, error)) {
+            case ThinResult::Thinned:
+                line = "thinned: " + files[i] + '\n';
+                break;
+            case ThinResult::NoSuchArch:
+                line = "no " + arch + " slice: " + files[i] + '\n';
                 break;
-            default:
+            case ThinResult::Failed:
+                line = "failed: " + files[i] + " (" + error + ")\n";
+                failed = true;
+                break;
+            case ThinResult::AlreadyThin:
+            case ThinResult::NotMachO:
+                // Nothing to do when walking a tree; an explicit -o needs a universal binary.
+                if (!output.empty()) {
+                    line = "not a universal binary: " + files[i] + '\n';
+                    failed = true;
+                }
                 break;
         }
+        pipeline.publish(i, std::move(line));
+    });
+    if (!pipeline.close()) {
+        std::cerr << "Failed to write output\n";
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
 
-        arrIndex += cmdsize;
+int mergeArchesCommand(const char *program, const std::vector<std::string> &args) {
+    std::string output;
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "-o" && i + 1 < args.size()) {
+            output = args[++i];
+        } else {
+            inputs.push_back(args[i]);
+        }
+    }
+    if (output.empty() || inputs.empty()) {
+        printUsage(program);
+        return 1;
     }
 
-    result.emplace_back(std::move(machOInfo));
-    return true;
+    std::string error;
+    if (!mergeArchitectures(inputs, output, error)) {
+        std::cerr << "Could not create " << output << ": " << error << '\n';
+        return 1;
+    }
+    return 0;
 }
 
-template <bool is64BitFatArch>
-void parseFatHeaderAndUpdateResult(std::ifstream &file,
-                                   std::vector<MachOInfo> &result) {
-    using FatArchType = typename std::conditional<is64BitFatArch, struct fat_arch_64, struct fat_arch>::type;
-
-    // Fat binary (universal binary), 32-bit header
-    struct fat_header fh {};
-    file.read(reinterpret_cast<char*>(&fh), sizeof(struct fat_header));
-    // Swap byte order, since all fields in the universal header are big-endian.
-    fh.nfat_arch = OSSwapInt32(fh.nfat_arch);
-
-    for (uint32_t i = 0; i < fh.nfat_arch; i++) {
-        // Read architecture info
-        FatArchType fa {};
-        file.seekg(sizeof(struct fat_header) + i * sizeof(FatArchType));
-        file.read(reinterpret_cast<char*>(&fa), sizeof(FatArchType));
-        fa.cputype = OSSwapInt32(fa.cputype);
-        fa.cpusubtype = OSSwapInt32(fa.cpusubtype);
-        if constexpr(is64BitFatArch) {
-            fa.offset = OSSwapInt64(fa.offset);
+int signCommand(const char *program, const std::vector<std::string> &args) {
+    unsigned jobs = defaultJobCount();
+    std::string identifier;
+    std::string output;
+    std::vector<std::string> files;
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto &arg = args[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < args.size()) {
+            if (!parseJobsOption(arg, args[++i], jobs)) {
+                return 1;
+            }
+        } else if (arg == "--identifier" && i + 1 < args.size()) {
+            identifier = args[++i];
+        } else if (arg == "-o" && i + 1 < args.size()) {
+            output = args[++i];
         } else {
-            fa.offset = OSSwapInt32(fa.offset);
+            files.push_back(arg);
         }
-        // Get architecture name
-        const NXArchInfo *arch = NXGetArchInfoFromCpuType(fa.cputype, fa.cpusubtype);
-        if (!arch) {
-            std::cout << "Unable to get architecture name\n";
-            continue;  // continue for loop
+    }
+    if (files.empty() || (!output.empty() && files.size() != 1)) {
+        printUsage(program);
+        return 1;
+    }
+
+    // Files one at a time; the threads go to hashing the pages of each.
+    bool failed = false;
+    for (const auto &file : files) {
+        std::string error;
+        if (adhocSignFile(file, output, identifier, jobs, error)) {
+            std::cout << "signed: " << file << '\n';
+        } else {
+            std::cout << "failed: " << file << " (" << error << ")\n";
+            failed = true;
         }
+    }
+    return failed ? 1 : 0;
+}
 
-        // Navigate to the beginning of architecture
-        file.seekg(fa.offset);
-        // Read the magic number of architecture
-        uint32_t magic;
-        file.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+int autolinkCommand(const char *program, const std::vector<std::string> &args) {
+    unsigned jobs = defaultJobCount();
+    LinkerSearchPaths searchPaths;
+    std::vector<std::string> libraryDirs;
+    std::vector<std::string> frameworkDirs;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto &arg = args[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < args.size()) {
+            if (!parseJobsOption(arg, args[++i], jobs)) {
+                return 1;
+            }
+        } else if (arg == "-L" && i + 1 < args.size()) {
+            libraryDirs.push_back(args[++i]);
+        } else if (arg == "-F" && i + 1 < args.size()) {
+            frameworkDirs.push_back(args[++i]);
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        printUsage(program);
+        return 1;
+    }
+    // Like ld, directories given on the command line are searched before the defaults.
+    searchPaths.libraryDirs.insert(searchPaths.libraryDirs.begin(), libraryDirs.begin(), libraryDirs.end());
+    searchPaths.frameworkDirs.insert(searchPaths.frameworkDirs.begin(), frameworkDirs.begin(), frameworkDirs.end());
 
-        file.seekg(fa.offset);
+    auto libraries = predictAutolinkLibraries(expandPaths(paths), searchPaths, jobs);
+    printAutolinkLibraries(libraries, std::cout);
+    return 0;
+}
 
-        if (magic == MH_MAGIC_64) {
-            constexpr bool is64BitMachHeader = true;
-            parseMachHeaderAndUpdateResult<is64BitMachHeader>(file, fa.offset, result);
-        } else {
-            constexpr bool is64BitMachHeader = false;
-            parseMachHeaderAndUpdateResult<is64BitMachHeader>(file, fa.offset, result);
-        }
-    }
-}
-
-std::vector<MachOInfo> parseMachO(const std::string &filename) {
-    // Open Mach-O File
-    std::ifstream file(filename, std::ios::binary | std::ios::in);
-    if (!file.is_open()) {
-        std::cout << "Could not open file: " << filename << '\n';
-        return {};
-    }
-
-    std::vector<MachOInfo> result;
-
-    // Read file header to determine if it's a Mach-O file
-    uint32_t magic;
-    file.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
-    file.seekg(0);
-
-    // Check the magic number
-    switch (magic) {
-        // Check if it's a fat binary (universal binary)
-        case FAT_MAGIC:
-        case FAT_CIGAM:
-        {
-            // Fat binary (universal binary), 32-bit header
-            constexpr bool is64BitFatArch = false;
-            parseFatHeaderAndUpdateResult<is64BitFatArch>(file, result);
-        } // cases for fat binaries
-            break;
-        case FAT_MAGIC_64:
-        case FAT_CIGAM_64:
-        {
-            // Fat binary (universal binary), 64-bit header
-            constexpr bool is64BitFatArch = true;
-            parseFatHeaderAndUpdateResult<is64BitFatArch>(file, result);
-        } // cases for fat binaries
-            break;
-        case MH_MAGIC:
-        case MH_CIGAM:
-        {
-            // Not a fat binary, only one architecture
-            // 32-bit
-            constexpr bool is64BitMachHeader = false;
-            parseMachHeaderAndUpdateResult<is64BitMachHeader>(file, 0, result);
-        } // cases for thin binaries
-            break;
-        case MH_MAGIC_64:
-        case MH_CIGAM_64:
-        {
-            // Not a fat binary, only one architecture
-            // 64-bit
-            constexpr bool is64BitMachHeader = true;
-            parseMachHeaderAndUpdateResult<is64BitMachHeader>(file, 0, result);
-        } // cases for thin binaries
-            break;
-        default:
-            std::cout << "File " << filename << " is not a Mach-O file\n";
-            return {};
-    }
-    return result;
+void printInformation(const std::string &name, const std::vector<MachOInfo> &result, TaskPool *pool,
+                      bool dlopenScan, std::ostream &out) {
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  info: " << ANSI_COLOR_RESET << '\n';
+    for (const auto &item : result) {
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  - arch: " << ANSI_COLOR_RESET << item.arch << '\n';
+        if (!item.dylib_id.empty()) {
+            out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    dylib_id: " << ANSI_COLOR_RESET
+                << item.dylib_id << '\n';
+        }
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    deps: " << ANSI_COLOR_RESET << '\n';
+        for (const auto &dep : item.deps) {
+            out << "    - " << dep.name << '\n';
+        }
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    rpaths: " << ANSI_COLOR_RESET << '\n';
+        for (const auto &rpath : item.rpaths) {
+            out << "    - " << rpath << '\n';
+        }
+        if (!item.linker_options.empty()) {
+            out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    linker_options: " << ANSI_COLOR_RESET << '\n';
+            for (const auto &option : item.linker_options) {
+                out << "    -";
+                for (const auto &argument : option) {
+                    out << ' ' << argument;
+                }
+                out << '\n';
+            }
+        }
+        if (dlopenScan) {
+            std::vector<std::string> candidates;
+            if (!findDlopenCandidates(name, item, candidates)) {
+                out << "Unable to read the string sections of " << name << " (" << item.arch << ")\n";
+            }
+            if (!candidates.empty()) {
+                out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    possible_runtime_dependencies: "
+                    << ANSI_COLOR_RESET << '\n';
+                for (const auto &candidate : candidates) {
+                    out << "    - " << candidate << '\n';
+                }
+            }
+        }
+        if (!item.fileset_entries.empty()) {
+            auto entries = parseFilesetEntries(name, item, pool, out);
+            out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    fileset_entries: " << ANSI_COLOR_RESET << '\n';
+            for (size_t i = 0; i < entries.size(); i++) {
+                out << "    - entry_id: " << item.fileset_entries[i].entry_id << '\n';
+                if (!entries[i].dylib_id.empty()) {
+                    out << "      dylib_id: " << entries[i].dylib_id << '\n';
+                }
+                out << "      deps:\n";
+                for (const auto &dep : entries[i].deps) {
+                    out << "      - " << dep.name << '\n';
+                }
+            }
+        }
+    }
+}
+
+void printClosures(const std::string &name, const std::vector<Closure> &closures, std::ostream &out) {
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  closures: " << ANSI_COLOR_RESET << '\n';
+    for (const auto &closure : closures) {
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  - arch: " << ANSI_COLOR_RESET << closure.arch << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    images: " << ANSI_COLOR_RESET << '\n';
+
+        std::vector<std::vector<const ClosureEdge *>> edgesByImage(closure.images.size());
+        for (const auto &edge : closure.edges) {
+            edgesByImage[edge.from].push_back(&edge);
+        }
+        for (size_t i = 0; i < closure.images.size(); i++) {
+            out << "    - path: " << closure.images[i].path << '\n';
+            if (edgesByImage[i].empty()) {
+                continue;
+            }
+            out << "      deps:\n";
+            for (auto edge : edgesByImage[i]) {
+                out << "      - " << edge->reference.name;
+                if (*dependencyKindName(edge->reference.command)) {
+                    out << " (" << dependencyKindName(edge->reference.command) << ')';
+                }
+                if (edge->to == Closure::kNotLoaded) {
+                    out << " -> not found\n";
+                } else {
+                    out << " -> " << edge->resolution.path << " (" << edge->resolution.via << ")";
+                    if (edge->incompatibleVersion) {
+                        out << " incompatible: requires " << formatVersion(edge->reference.compatibilityVersion)
+                            << ", provides " << formatVersion(closure.images[edge->to].info.compatibility_version);
+                    }
+                    out << '\n';
+                }
+            }
+        }
+    }
+}
+
+void printCollisions(const std::string &name, const Closure &closure,
+                     const std::vector<InstallNameCollision> &collisions, std::ostream &out) {
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  arch: " << ANSI_COLOR_RESET << closure.arch << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  collisions: " << ANSI_COLOR_RESET << '\n';
+    for (const auto &collision : collisions) {
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  - dylib_id: " << ANSI_COLOR_RESET
+            << collision.installName << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    images: " << ANSI_COLOR_RESET << '\n';
+        for (size_t i = 0; i < collision.images.size(); i++) {
+            out << "    - " << closure.images[collision.images[i]].path
+                << " (" << (collision.readable[i] ? hashToString(collision.hashes[i]) : "unreadable")
+                << (i == 0 ? ", loaded first" : "") << ")\n";
+        }
+    }
+    out << '\n';
+}
+
+void printVersionMismatches(const std::string &name, const Closure &closure, std::ostream &out) {
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  arch: " << ANSI_COLOR_RESET << closure.arch << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  incompatible: " << ANSI_COLOR_RESET << '\n';
+    for (const auto &edge : closure.edges) {
+        if (!edge.incompatibleVersion) {
+            continue;
+        }
+        const auto &provider = closure.images[edge.to];
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  - consumer: " << ANSI_COLOR_RESET
+            << closure.images[edge.from].path << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    provider: " << ANSI_COLOR_RESET << provider.path << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    requires: " << ANSI_COLOR_RESET
+            << formatVersion(edge.reference.compatibilityVersion) << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    provides: " << ANSI_COLOR_RESET
+            << formatVersion(provider.info.compatibility_version)
+            << " (current " << formatVersion(provider.info.current_version) << ")\n";
+    }
+    out << '\n';
+}
+
+// Returns false if a slice has too little padding for the edits.
+bool printPadding(const std::string &name, const LoadCommandEdits &edits, std::ostream &out) {
+    auto result = parseMachO(name, out);
+    bool fits = true;
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  info: " << ANSI_COLOR_RESET << '\n';
+    for (const auto &item : result) {
+        auto padding = headerPadding(item);
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  - arch: " << ANSI_COLOR_RESET << item.arch << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    padding: " << ANSI_COLOR_RESET << padding << '\n';
+        if (edits.empty()) {
+            continue;
+        }
+        auto growth = loadCommandGrowth(item, edits);
+        bool sliceFits = growth <= 0 || static_cast<uint64_t>(growth) <= padding;
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    required: " << ANSI_COLOR_RESET << growth << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    fits: " << ANSI_COLOR_RESET
+            << (sliceFits ? "yes" : "no") << '\n';
+        fits = fits && sliceFits;
+    }
+    return fits;
+}
+
+void printDuplicateSymbols(const std::string &name, const Closure &closure,
+                           const std::vector<DuplicateSymbol> &duplicates,
+                           const std::vector<size_t> &unreadable, std::ostream &out) {
+    const auto &root = closure.images.front().info;
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  arch: " << ANSI_COLOR_RESET << closure.arch << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  namespace: " << ANSI_COLOR_RESET
+        << ((root.flags & MH_TWOLEVEL) ? "two-level" : "flat") << '\n';
+    if (!unreadable.empty()) {
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  unreadable: " << ANSI_COLOR_RESET << '\n';
+        for (auto index : unreadable) {
+            out << "  - " << closure.images[index].path << '\n';
+        }
+    }
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  duplicates: " << ANSI_COLOR_RESET << '\n';
+    for (const auto &duplicate : duplicates) {
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  - symbol: " << ANSI_COLOR_RESET << duplicate.name << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "    images: " << ANSI_COLOR_RESET << '\n';
+        for (size_t i = 0; i < duplicate.images.size(); i++) {
+            out << "    - " << closure.images[duplicate.images[i]].path << (i == 0 ? " (wins)" : "") << '\n';
+        }
+    }
+    out << '\n';
+}
+
+void printFootprint(const std::string &name, const Closure &closure, const ClosureFootprint &footprint,
+                    std::ostream &out) {
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  arch: " << ANSI_COLOR_RESET << closure.arch << '\n';
+    auto total = footprint.bundled;
+    total += footprint.system;
+    std::pair<const char *, const Footprint *> groups[] = {
+        {"bundled", &footprint.bundled}, {"system", &footprint.system}, {"total", &total},
+    };
+    for (const auto &group : groups) {
+        const auto &sizes = *group.second;
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  " << group.first << ": " << ANSI_COLOR_RESET << '\n';
+        out << "    images: " << sizes.images << '\n';
+        out << "    clean_vmsize: " << sizes.cleanVmSize << '\n';
+        out << "    clean_filesize: " << sizes.cleanFileSize << '\n';
+        out << "    dirty_vmsize: " << sizes.dirtyVmSize << '\n';
+        out << "    dirty_filesize: " << sizes.dirtyFileSize << '\n';
+        out << "    dirty_pages: " << sizes.dirtyPages << '\n';
+    }
+    out << '\n';
+}
+
+void printFingerprint(const std::string &name, const Closure &closure, const Sha256Digest &fingerprint,
+                      const std::vector<size_t> &unreadable, std::ostream &out) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (auto byte : fingerprint) {
+        hex += digits[byte >> 4];
+        hex += digits[byte & 0xf];
+    }
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- filename: " << ANSI_COLOR_RESET << name << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  arch: " << ANSI_COLOR_RESET << closure.arch << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  images: " << ANSI_COLOR_RESET << closure.images.size() << '\n';
+    if (!unreadable.empty()) {
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  unreadable: " << ANSI_COLOR_RESET << '\n';
+        for (auto index : unreadable) {
+            out << "  - " << closure.images[index].path << '\n';
+        }
+    }
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  fingerprint: " << ANSI_COLOR_RESET << hex << "\n\n";
+}
+
+void printOrphans(const std::string &bundle, const std::vector<BundleFile> &files, const OrphanReport &report,
+                  std::ostream &out) {
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- bundle: " << ANSI_COLOR_RESET << bundle << '\n';
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  roots: " << ANSI_COLOR_RESET << '\n';
+    for (auto index : report.roots) {
+        out << "  - " << files[index].path << '\n';
+    }
+    uint64_t total = 0;
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  orphans: " << ANSI_COLOR_RESET << '\n';
+    for (const auto &orphan : report.orphans) {
+        out << "  - " << files[orphan.file].path << " (" << orphan.size << " bytes)\n";
+        total += orphan.size;
+    }
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "  orphaned_bytes: " << ANSI_COLOR_RESET << total << "\n\n";
+}
+
+void printAutolinkLibraries(const std::vector<AutolinkLibrary> &libraries, std::ostream &out) {
+    size_t dylibs = 0;
+    for (const auto &library : libraries) {
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "- option: " << ANSI_COLOR_RESET << library.option << '\n';
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  kind: " << ANSI_COLOR_RESET
+            << autolinkKindName(library.kind) << '\n';
+        if (!library.path.empty()) {
+            out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  path: " << ANSI_COLOR_RESET << library.path << '\n';
+        }
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_GREEN << "  objects: " << ANSI_COLOR_RESET << '\n';
+        for (const auto &object : library.objects) {
+            out << "  - " << object << '\n';
+        }
+        dylibs += library.kind == AutolinkKind::Dylib;
+    }
+    out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "predicted dylibs: " << ANSI_COLOR_RESET << dylibs << '\n';
+}
+
+void printSysroot(const PathMapper &mapper, std::ostream &out) {
+    if (!mapper.sysroot().empty()) {
+        out << ANSI_COLOR_BOLD << ANSI_COLOR_BLUE << "# sysroot: " << ANSI_COLOR_RESET << mapper.sysroot() << "\n\n";
+    }
 }
@@ -0,0 +1,17 @@
+#ifndef MACDEPENDENCY_NUMBER_PARSER_H
+#define MACDEPENDENCY_NUMBER_PARSER_H
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+
+
+// A whole decimal number without sign or surrounding spaces, such as the
+// value of -j. Returns false for anything else, or on overflow.
+inline bool parseUnsigned(const std::string &text, uint64_t &value) {
+    const char *end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+#endif // MACDEPENDENCY_NUMBER_PARSER_H
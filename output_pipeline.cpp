@@ -0,0 +1,168 @@
+#include "output_pipeline.h"
+
+#include <cerrno>
+#include <climits>
+#include <map>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Flush once a batch holds this many bytes, even if more output is queued.
+static constexpr size_t kMaxBatchBytes = 8 * 1024 * 1024;
+static constexpr size_t kMaxBatchBuffers = IOV_MAX;
+
+
+OutputPipeline::OutputPipeline(int fd, bool preserveOrder)
+    : fd_(fd), preserveOrder_(preserveOrder) {
+    writer_ = std::thread(&OutputPipeline::writerLoop, this);
+}
+
+OutputPipeline::~OutputPipeline() {
+    if (writer_.joinable()) {
+        close();
+    }
+}
+
+void OutputPipeline::publish(uint64_t seq, std::string buffer) {
+    auto node = new Node {nullptr, seq, std::move(buffer)};
+    node->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(node->next, node)) {
+        // node->next has been reloaded, try again
+    }
+    if (writerSleeping_.load()) {
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        parkCondition_.notify_one();
+    }
+}
+
+bool OutputPipeline::close() {
+    closing_.store(true);
+    {
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        parkCondition_.notify_one();
+    }
+    writer_.join();
+    return !failed_;
+}
+
+OutputPipeline::Node *OutputPipeline::takeAll() {
+    // Producers push onto a stack, so reverse it to get publication order.
+    Node *stack = head_.exchange(nullptr, std::memory_order_acquire);
+    Node *list = nullptr;
+    while (stack) {
+        Node *next = stack->next;
+        stack->next = list;
+        list = stack;
+        stack = next;
+    }
+    return list;
+}
+
+void OutputPipeline::writerLoop() {
+    std::vector<Node *> batch;
+    size_t batchBytes = 0;
+    // Buffers that arrived before their predecessors (ordered mode only)
+    std::map<uint64_t, Node *> waiting;
+    uint64_t nextSeq = 0;
+
+    auto flush = [&]() {
+        if (!batch.empty() && !failed_) {
+            failed_ = !writeBatch(batch.data(), batch.size());
+        }
+        for (auto node : batch) {
+            delete node;
+        }
+        batch.clear();
+        batchBytes = 0;
+    };
+    auto append = [&](Node *node) {
+        if (node->buffer.empty()) {
+            delete node;
+            return;
+        }
+        batchBytes += node->buffer.size();
+        batch.push_back(node);
+        if (batch.size() >= kMaxBatchBuffers || batchBytes >= kMaxBatchBytes) {
+            flush();
+        }
+    };
+
+    for (;;) {
+        Node *list = takeAll();
+        if (!list) {
+            // Nothing queued: write out what we have instead of holding it back.
+            flush();
+            if (closing_.load()) {
+                list = takeAll();
+                if (!list) {
+                    break;
+                }
+            } else {
+                std::unique_lock<std::mutex> lock(parkMutex_);
+                writerSleeping_.store(true);
+                if (!head_.load() && !closing_.load()) {
+                    parkCondition_.wait(lock);
+                }
+                writerSleeping_.store(false);
+                continue;
+            }
+        }
+
+        while (list) {
+            Node *node = list;
+            list = list->next;
+            if (!preserveOrder_) {
+                append(node);
+                continue;
+            }
+            waiting.emplace(node->seq, node);
+            for (auto it = waiting.begin(); it != waiting.end() && it->first == nextSeq; it = waiting.begin()) {
+                append(it->second);
+                waiting.erase(it);
+                nextSeq++;
+            }
+        }
+    }
+
+    // Sequence numbers that were never published; keep the rest in order anyway.
+    for (auto &entry : waiting) {
+        append(entry.second);
+    }
+    flush();
+}
+
+bool OutputPipeline::writeBatch(Node **nodes, size_t count) {
+    std::vector<struct iovec> iov(count);
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = const_cast<char *>(nodes[i]->buffer.data());
+        iov[i].iov_len = nodes[i]->buffer.size();
+    }
+
+    size_t first = 0;
+    while (first < count) {
+        ssize_t written = writev(fd_, &iov[first], static_cast<int>(count - first));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // Skip the buffers written completely, then the written part of the next one.
+        auto remaining = static_cast<size_t>(written);
+        while (first < count && remaining >= iov[first].iov_len) {
+            remaining -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count) {
+            iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + remaining;
+            iov[first].iov_len -= remaining;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef MACDEPENDENCY_OUTPUT_PIPELINE_H
+#define MACDEPENDENCY_OUTPUT_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+// Single writer for output produced by many worker threads.
+//
+// Workers format into their own buffers and hand them over with publish(),
+// which pushes onto a lock-free multi-producer single-consumer queue. A
+// dedicated writer thread drains the queue and flushes the buffers to the file
+// descriptor with writev() in large batches.
+//
+// When order is preserved, buffers are written in sequence number order
+// (0, 1, 2, ...) no matter in which order they were published, so every
+// sequence number must be published exactly once (an empty buffer is fine).
+class OutputPipeline {
+public:
+    OutputPipeline(int fd, bool preserveOrder);
+    ~OutputPipeline();
+
+    OutputPipeline(const OutputPipeline &) = delete;
+    OutputPipeline &operator=(const OutputPipeline &) = delete;
+
+    // Thread-safe, never blocks on the writer.
+    void publish(uint64_t seq, std::string buffer);
+
+    // Writes everything published so far and stops the writer thread.
+    // Returns false if any write failed.
+    bool close();
+
+private:
+    struct Node {
+        Node *next;
+        uint64_t seq;
+        std::string buffer;
+    };
+
+    void writerLoop();
+    Node *takeAll();
+    bool writeBatch(Node **nodes, size_t count);
+
+    int fd_;
+    bool preserveOrder_;
+    std::atomic<Node *> head_ {nullptr};
+    std::atomic<bool> closing_ {false};
+    std::atomic<bool> writerSleeping_ {false};
+    bool failed_ = false;
+    // Only used to park the writer while the queue is empty.
+    std::mutex parkMutex_;
+    std::condition_variable parkCondition_;
+    std::thread writer_;
+};
+
+#endif // MACDEPENDENCY_OUTPUT_PIPELINE_H
@@ -0,0 +1,46 @@
+#ifndef MACDEPENDENCY_PARALLEL_H
+#define MACDEPENDENCY_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+
+// Number of worker threads to use when the user did not ask for a number.
+inline unsigned defaultJobCount() {
+    unsigned count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+// Calls function(i) for every i in [0, count) from up to `jobs` threads.
+// Indices are handed out one at a time, so uneven work balances itself.
+template <typename Function>
+void parallelFor(size_t count, unsigned jobs, Function &&function) {
+    size_t threadCount = std::min<size_t>(std::max(jobs, 1u), count);
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            function(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next {0};
+    auto worker = [&]() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            function(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+#endif // MACDEPENDENCY_PARALLEL_H
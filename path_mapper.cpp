@@ -0,0 +1,95 @@
+#include "path_mapper.h"
+
+#include <filesystem>
+
+
+PathMapper::PathMapper()
+    : nodes_(1) {
+}
+
+void PathMapper::setSysroot(const std::string &dir) {
+    sysroot_ = dir;
+    addRule("/", dir);
+}
+
+void PathMapper::addRule(const std::string &prefix, const std::string &dir) {
+    auto &node = nodes_[nodeFor(prefix)];
+    node.target = std::filesystem::absolute(dir).lexically_normal().string();
+    // "dir/" and "dir" are the same directory; the rest of a path brings its own slash.
+    while (node.target.size() > 1 && node.target.back() == '/') {
+        node.target.pop_back();
+    }
+    node.hasTarget = true;
+    mapped_.clear();
+}
+
+bool PathMapper::parseRule(const std::string &rule) {
+    auto equals = rule.find('=');
+    if (equals == std::string::npos) {
+        return false;
+    }
+    addRule(rule.substr(0, equals), rule.substr(equals + 1));
+    return true;
+}
+
+size_t PathMapper::nodeFor(const std::string &prefix) {
+    size_t node = 0;
+    std::string::size_type start = 0;
+    while (start < prefix.size()) {
+        auto end = prefix.find('/', start);
+        if (end == std::string::npos) {
+            end = prefix.size();
+        }
+        if (end > start) {
+            auto component = prefix.substr(start, end - start);
+            auto child = nodes_[node].children.find(component);
+            if (child == nodes_[node].children.end()) {
+                // Indices rather than pointers, since nodes_ grows
+                nodes_.emplace_back();
+                child = nodes_[node].children.emplace(component, nodes_.size() - 1).first;
+            }
+            node = child->second;
+        }
+        start = end + 1;
+    }
+    return node;
+}
+
+const std::string &PathMapper::map(const std::string &path) {
+    auto cached = mapped_.find(path);
+    if (cached != mapped_.end()) {
+        return cached->second;
+    }
+
+    std::string result = path;
+    if (!path.empty() && path[0] == '/') {
+        // Deepest node with a target along the path, and where the rest of the path starts
+        const Node *best = nodes_[0].hasTarget ? &nodes_[0] : nullptr;
+        std::string::size_type bestRest = 0;
+        size_t node = 0;
+        std::string::size_type start = 0;
+        while (start < path.size()) {
+            auto end = path.find('/', start);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            if (end > start) {
+                auto child = nodes_[node].children.find(path.substr(start, end - start));
+                if (child == nodes_[node].children.end()) {
+                    break;
+                }
+                node = child->second;
+                if (nodes_[node].hasTarget) {
+                    best = &nodes_[node];
+                    bestRest = end;
+                }
+            }
+            start = end + 1;
+        }
+        if (best) {
+            auto rest = path.substr(bestRest);
+            result = best->target == "/" ? (rest.empty() ? "/" : rest) : best->target + rest;
+        }
+    }
+    return mapped_.emplace(path, std::move(result)).first->second;
+}
@@ -0,0 +1,50 @@
+#ifndef MACDEPENDENCY_PATH_MAPPER_H
+#define MACDEPENDENCY_PATH_MAPPER_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Rewrites absolute paths of the system being analyzed into where that
+// system's files are on this machine: a sysroot for everything, and
+// `--map prefix=dir` rules for parts of it. The rules form a trie over path
+// components, so the most specific rule wins and lookups cost one step per
+// component. Results are memoized. Not thread-safe.
+class PathMapper {
+public:
+    PathMapper();
+
+    // Maps every absolute path that no rule covers into `dir`.
+    void setSysroot(const std::string &dir);
+
+    // Maps `prefix` and everything below it, on component boundaries, to `dir`.
+    // A relative `dir` is taken relative to the current directory.
+    void addRule(const std::string &prefix, const std::string &dir);
+
+    // Applies a "prefix=dir" rule. Returns false if there is no '='.
+    bool parseRule(const std::string &rule);
+
+    const std::string &sysroot() const { return sysroot_; }
+
+    // The path on this machine. Relative paths and absolute paths that no
+    // rule covers come back unchanged.
+    const std::string &map(const std::string &path);
+
+private:
+    struct Node {
+        std::map<std::string, size_t> children;  // component -> index in nodes_
+        std::string target;
+        bool hasTarget = false;
+    };
+
+    size_t nodeFor(const std::string &prefix);
+
+    std::vector<Node> nodes_;  // nodes_[0] is "/"
+    std::string sysroot_;
+    std::unordered_map<std::string, std::string> mapped_;
+};
+
+#endif // MACDEPENDENCY_PATH_MAPPER_H
@@ -0,0 +1,835 @@
+#include "record_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "content_hash.h"
+#include "file_copy.h"
+#include "file_walker.h"
+
+
+// File layout: a header page, `slotCount` u64 index slots, then the log of
+// records, each
+//   u32 kind, u32 key size, u32 payload size, u32 padding,
+//   u64 file size, i64 mtime, u64 inode, key, payload
+// padded to 8 bytes, all in host byte order; the cache is not meant to move
+// between machines. A slot is 0 while free, or holds the top 16 bits of the
+// key's hash and the record's offset divided by 8. The payload of a directory
+// is
+//   u32 entry count, per entry: u32 name size, name, u8 kind
+// and the key of a slice hash is the file, a NUL and the slice offset in
+// decimal, with the u64 hash as payload.
+//
+// Records are only ever appended, and the file never shrinks, so a mapping
+// of the whole window stays valid while other processes grow the file.
+static const char kCacheMagic[8] = {'M', 'D', 'E', 'P', 'C', 'A', 'C', 'H'};
+static constexpr uint32_t kCacheVersion = 5;  // bump whenever MachOInfo or the encoding changes
+static constexpr uint64_t kHeaderSize = 4096;
+static constexpr uint64_t kMinSlotCount = 1 << 16;
+static constexpr uint64_t kSlotOffsetMask = (uint64_t(1) << 48) - 1;
+// Address space reserved for the mapping; the log is not grown past it
+static constexpr uint64_t kWindowSize = sizeof(void *) == 8 ? uint64_t(1) << 34 : uint64_t(1) << 30;
+
+// The counters are shared by every process using the file, and only
+// accessed atomically.
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t retired;        // nonzero once a compaction replaced the file
+    uint64_t slotCount;      // a power of two
+    uint64_t logEnd;         // where the next record goes
+    uint64_t usedSlots;
+    uint64_t replacedSlots;  // slots whose key has a newer record
+};
+
+struct RecordHeader {
+    uint32_t kind;
+    uint32_t keySize;
+    uint32_t payloadSize;
+    uint32_t padding;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t inode;
+};
+
+// Appends fixed-size integers and length-prefixed strings
+class Encoder {
+public:
+    explicit Encoder(std::string &out) : out_(out) {}
+
+    template <typename T>
+    void put(T value) {
+        out_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void put(const std::string &value) {
+        put(static_cast<uint32_t>(value.size()));
+        out_.append(value);
+    }
+
+    void put(const std::vector<std::string> &values) {
+        put(static_cast<uint32_t>(values.size()));
+        for (const auto &value : values) {
+            put(value);
+        }
+    }
+
+private:
+    std::string &out_;
+};
+
+// Reads what Encoder wrote; once anything is out of bounds, ok() stays false
+class Decoder {
+public:
+    Decoder(const char *data, size_t size) : pos_(data), end_(data + size) {}
+
+    bool ok() const { return ok_; }
+    bool atEnd() const { return pos_ == end_; }
+
+    template <typename T>
+    void get(T &value) {
+        if (!ok_ || static_cast<size_t>(end_ - pos_) < sizeof(T)) {
+            ok_ = false;
+            value = T {};
+            return;
+        }
+        std::memcpy(&value, pos_, sizeof(T));
+        pos_ += sizeof(T);
+    }
+
+    void get(std::string &value) {
+        uint32_t size = 0;
+        get(size);
+        if (!ok_ || static_cast<size_t>(end_ - pos_) < size) {
+            ok_ = false;
+            return;
+        }
+        value.assign(pos_, size);
+        pos_ += size;
+    }
+
+    void get(std::vector<std::string> &values) {
+        uint32_t count = 0;
+        get(count);
+        for (uint32_t i = 0; ok_ && i < count; i++) {
+            values.emplace_back();
+            get(values.back());
+        }
+    }
+
+    // Element count of a list, bounded by what could possibly follow
+    uint32_t count(size_t minimumElementSize) {
+        uint32_t value = 0;
+        get(value);
+        if (ok_ && value > static_cast<size_t>(end_ - pos_) / minimumElementSize) {
+            ok_ = false;
+            return 0;
+        }
+        return value;
+    }
+
+private:
+    const char *pos_;
+    const char *end_;
+    bool ok_ = true;
+};
+
+static void encodeInfo(const MachOInfo &info, Encoder &encoder) {
+    encoder.put(info.arch);
+    encoder.put(info.cputype);
+    encoder.put(info.cpusubtype);
+    encoder.put(info.filetype);
+    encoder.put(info.offset);
+    encoder.put(info.size);
+    encoder.put(info.flags);
+    encoder.put(static_cast<uint8_t>(info.is_64_bit));
+    encoder.put(info.exports_trie_offset);
+    encoder.put(info.exports_trie_size);
+    encoder.put(info.symtab_offset);
+    encoder.put(info.symtab_count);
+    encoder.put(info.strtab_offset);
+    encoder.put(info.strtab_size);
+    encoder.put(info.sizeofcmds);
+    encoder.put(static_cast<uint32_t>(info.segments.size()));
+    for (const auto &segment : info.segments) {
+        encoder.put(segment.name);
+        encoder.put(segment.vmaddr);
+        encoder.put(segment.vmsize);
+        encoder.put(segment.fileoff);
+        encoder.put(segment.filesize);
+        encoder.put(segment.maxprot);
+        encoder.put(segment.initprot);
+    }
+    encoder.put(static_cast<uint32_t>(info.sections.size()));
+    for (const auto &section : info.sections) {
+        encoder.put(section.segname);
+        encoder.put(section.sectname);
+        encoder.put(section.addr);
+        encoder.put(section.size);
+        encoder.put(section.offset);
+        encoder.put(section.flags);
+    }
+    encoder.put(info.dylib_id);
+    encoder.put(info.current_version);
+    encoder.put(info.compatibility_version);
+    encoder.put(static_cast<uint32_t>(info.deps.size()));
+    for (const auto &dep : info.deps) {
+        encoder.put(dep.name);
+        encoder.put(dep.command);
+        encoder.put(dep.currentVersion);
+        encoder.put(dep.compatibilityVersion);
+    }
+    encoder.put(info.rpaths);
+    encoder.put(static_cast<uint32_t>(info.linker_options.size()));
+    for (const auto &option : info.linker_options) {
+        encoder.put(option);
+    }
+    encoder.put(static_cast<uint32_t>(info.fileset_entries.size()));
+    for (const auto &entry : info.fileset_entries) {
+        encoder.put(entry.entry_id);
+        encoder.put(entry.vmaddr);
+        encoder.put(entry.fileoff);
+    }
+    encoder.put(static_cast<uint8_t>(info.text_stub));
+    encoder.put(info.exports);
+}
+
+static void decodeInfo(Decoder &decoder, MachOInfo &info) {
+    uint8_t flag = 0;
+    decoder.get(info.arch);
+    decoder.get(info.cputype);
+    decoder.get(info.cpusubtype);
+    decoder.get(info.filetype);
+    decoder.get(info.offset);
+    decoder.get(info.size);
+    decoder.get(info.flags);
+    decoder.get(flag);
+    info.is_64_bit = flag != 0;
+    decoder.get(info.exports_trie_offset);
+    decoder.get(info.exports_trie_size);
+    decoder.get(info.symtab_offset);
+    decoder.get(info.symtab_count);
+    decoder.get(info.strtab_offset);
+    decoder.get(info.strtab_size);
+    decoder.get(info.sizeofcmds);
+    for (uint32_t i = 0, count = decoder.count(4); decoder.ok() && i < count; i++) {
+        SegmentInfo segment {};
+        decoder.get(segment.name);
+        decoder.get(segment.vmaddr);
+        decoder.get(segment.vmsize);
+        decoder.get(segment.fileoff);
+        decoder.get(segment.filesize);
+        decoder.get(segment.maxprot);
+        decoder.get(segment.initprot);
+        info.segments.push_back(std::move(segment));
+    }
+    for (uint32_t i = 0, count = decoder.count(8); decoder.ok() && i < count; i++) {
+        SectionInfo section {};
+        decoder.get(section.segname);
+        decoder.get(section.sectname);
+        decoder.get(section.addr);
+        decoder.get(section.size);
+        decoder.get(section.offset);
+        decoder.get(section.flags);
+        info.sections.push_back(std::move(section));
+    }
+    decoder.get(info.dylib_id);
+    decoder.get(info.current_version);
+    decoder.get(info.compatibility_version);
+    for (uint32_t i = 0, count = decoder.count(4); decoder.ok() && i < count; i++) {
+        DylibReference dep {};
+        decoder.get(dep.name);
+        decoder.get(dep.command);
+        decoder.get(dep.currentVersion);
+        decoder.get(dep.compatibilityVersion);
+        info.deps.push_back(std::move(dep));
+    }
+    decoder.get(info.rpaths);
+    for (uint32_t i = 0, count = decoder.count(4); decoder.ok() && i < count; i++) {
+        info.linker_options.emplace_back();
+        decoder.get(info.linker_options.back());
+    }
+    for (uint32_t i = 0, count = decoder.count(4); decoder.ok() && i < count; i++) {
+        FilesetEntry entry {};
+        decoder.get(entry.entry_id);
+        decoder.get(entry.vmaddr);
+        decoder.get(entry.fileoff);
+        info.fileset_entries.push_back(std::move(entry));
+    }
+    decoder.get(flag);
+    info.text_stub = flag != 0;
+    decoder.get(info.exports);
+}
+
+void encodeParseResult(const std::vector<MachOInfo> &result, std::string &out) {
+    Encoder encoder(out);
+    encoder.put(static_cast<uint32_t>(result.size()));
+    for (const auto &info : result) {
+        encodeInfo(info, encoder);
+    }
+}
+
+bool decodeParseResult(const char *data, size_t size, std::vector<MachOInfo> &result) {
+    Decoder decoder(data, size);
+    uint32_t count = decoder.count(4);
+    result.clear();
+    for (uint32_t i = 0; decoder.ok() && i < count; i++) {
+        result.emplace_back();
+        decodeInfo(decoder, result.back());
+    }
+    return decoder.ok() && decoder.atEnd();
+}
+
+// One mapping of a cache file, from its start over the whole window. Pages
+// past the end of the file are never touched: a record is read only once a
+// slot points at it, which happens after it was written.
+struct RecordCache::Generation {
+    int fd = -1;
+    bool writable = false;
+    char *data = nullptr;
+    CacheHeader *header = nullptr;
+    uint64_t *slots = nullptr;
+    uint64_t mask = 0;  // slot count - 1
+    uint64_t logStart = 0;
+    std::atomic<uint64_t> fileSize {0};  // as of the last fstat()
+
+    Generation(int fd, bool writable) : fd(fd), writable(writable) {}
+
+    ~Generation() {
+        if (data) {
+            munmap(data, kWindowSize);
+        }
+        close(fd);
+    }
+
+    bool map();
+    bool covers(uint64_t offset, uint64_t size);
+    bool read(uint64_t offset, Record &record);
+    bool readMatching(uint64_t slot, uint64_t hash, RecordKind kind, const std::string &key, Record &record);
+};
+
+static uint64_t keyHash(uint32_t kind, const char *key, size_t size) {
+    return hashBytes(key, size, kind);
+}
+
+static CacheHeader cacheHeader(uint64_t slotCount, uint64_t logEnd, uint64_t usedSlots) {
+    CacheHeader header {};
+    std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.slotCount = slotCount;
+    header.logEnd = logEnd;
+    header.usedSlots = usedSlots;
+    return header;
+}
+
+// An empty cache file, put in place unless `replace` is false and another
+// process got there first
+static void createCacheFile(const std::string &path, bool replace) {
+    uint64_t logStart = kHeaderSize + kMinSlotCount * sizeof(uint64_t);
+    auto header = cacheHeader(kMinSlotCount, logStart, 0);
+    AtomicFile out(path, 0644);
+    if (out.fd() >= 0 && ftruncate(out.fd(), static_cast<off_t>(logStart)) == 0
+        && writeAt(out.fd(), &header, sizeof(header), 0)) {
+        out.commit(replace);
+    }
+}
+
+bool RecordCache::Generation::map() {
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < kHeaderSize) {
+        return false;
+    }
+    void *mapped = mmap(nullptr, kWindowSize, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    data = static_cast<char *>(mapped);
+    header = reinterpret_cast<CacheHeader *>(data);
+    fileSize = static_cast<uint64_t>(st.st_size);
+
+    uint64_t slotCount = header->slotCount;
+    if (std::memcmp(header->magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header->version != kCacheVersion
+        || slotCount == 0 || (slotCount & (slotCount - 1)) != 0 || slotCount > kWindowSize / 16
+        || fileSize < kHeaderSize + slotCount * sizeof(uint64_t)) {
+        return false;
+    }
+    slots = reinterpret_cast<uint64_t *>(data + kHeaderSize);
+    mask = slotCount - 1;
+    logStart = kHeaderSize + slotCount * sizeof(uint64_t);
+    return true;
+}
+
+// Whether the file holds [offset, offset + size). Other processes only ever
+// grow it, so the size is checked again only when the known one is too small.
+bool RecordCache::Generation::covers(uint64_t offset, uint64_t size) {
+    if (offset > kWindowSize || size > kWindowSize - offset) {
+        return false;
+    }
+    if (offset + size <= fileSize.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    fileSize.store(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+    return offset + size <= static_cast<uint64_t>(st.st_size);
+}
+
+bool RecordCache::Generation::read(uint64_t offset, Record &record) {
+    RecordHeader header {};
+    if (offset < logStart || offset % 8 != 0 || !covers(offset, sizeof(header))) {
+        return false;
+    }
+    std::memcpy(&header, data + offset, sizeof(header));
+    uint64_t size = (sizeof(header) + uint64_t(header.keySize) + header.payloadSize + 7) & ~uint64_t(7);
+    if (!covers(offset, size)) {
+        return false;
+    }
+    record.offset = offset;
+    record.size = size;
+    record.kind = static_cast<RecordKind>(header.kind);
+    record.stamp = {header.size, header.mtime, header.inode};
+    record.key = data + offset + sizeof(header);
+    record.keySize = header.keySize;
+    record.payload = record.key + header.keySize;
+    record.payloadSize = header.payloadSize;
+    return true;
+}
+
+// The record a slot points at, if it is the one of the key
+bool RecordCache::Generation::readMatching(uint64_t slot, uint64_t hash, RecordKind kind, const std::string &key,
+                                           Record &record) {
+    return slot != 0 && ((slot ^ hash) & ~kSlotOffsetMask) == 0 && read((slot & kSlotOffsetMask) << 3, record)
+        && record.kind == kind && record.keySize == key.size() && std::memcmp(record.key, key.data(), key.size()) == 0;
+}
+
+RecordCache::RecordCache(std::string path, std::ostream &out)
+    : path_(std::move(path)) {
+    if (path_.empty()) {
+        return;
+    }
+    bool foreign = false;
+    if (auto generation = openGeneration(foreign)) {
+        generation_ = generation.get();
+        generations_.push_back(std::move(generation));
+    } else if (foreign) {
+        out << "Not a cache file, running without the cache: " << path_ << '\n';
+        path_.clear();
+    }
+}
+
+RecordCache::~RecordCache() = default;
+
+// A missing cache file is created, and an empty or damaged one, or one of
+// another cache version, is started over. Anything else at the path is left
+// alone and sets `foreign`, since it is more likely a mistyped path than a
+// cache.
+std::unique_ptr<RecordCache::Generation> RecordCache::openGeneration(bool &foreign) const {
+    foreign = false;
+    for (int attempt = 0; attempt < 3; attempt++) {
+        bool writable = true;
+        int fd = open(path_.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+            writable = false;
+            fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd < 0) {
+            if (errno != ENOENT) {
+                return nullptr;
+            }
+            createCacheFile(path_, false);
+            continue;
+        }
+        auto generation = std::make_unique<Generation>(fd, writable);
+        if (generation->map()) {
+            return generation;
+        }
+        char magic[sizeof(kCacheMagic)] {};
+        ssize_t read = pread(fd, magic, sizeof(magic), 0);
+        if (read != 0 && (read != sizeof(magic) || std::memcmp(magic, kCacheMagic, sizeof(magic)) != 0)) {
+            foreign = true;
+            return nullptr;
+        }
+        if (!writable) {
+            return nullptr;
+        }
+        createCacheFile(path_, true);
+    }
+    return nullptr;
+}
+
+// The generation to append to: once a compaction retired the current one,
+// the file that replaced it. Readers go on with whichever one they have.
+RecordCache::Generation *RecordCache::writableGeneration() {
+    Generation *generation = generation_.load(std::memory_order_acquire);
+    if (!generation) {
+        return nullptr;
+    }
+    if (__atomic_load_n(&generation->header->retired, __ATOMIC_ACQUIRE)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation = generation_.load(std::memory_order_relaxed);
+        if (__atomic_load_n(&generation->header->retired, __ATOMIC_ACQUIRE)) {
+            bool foreign = false;
+            if (auto next = openGeneration(foreign)) {
+                generation = next.get();
+                generations_.push_back(std::move(next));
+                generation_.store(generation, std::memory_order_release);
+            }
+        }
+    }
+    return generation->writable ? generation : nullptr;
+}
+
+bool RecordCache::stampOf(const std::string &file, Stamp &stamp) {
+    struct stat st {};
+    if (stat(file.c_str(), &st) != 0) {
+        return false;
+    }
+#ifdef __APPLE__
+    const auto &mtime = st.st_mtimespec;
+#else
+    const auto &mtime = st.st_mtim;
+#endif
+    stamp.size = static_cast<uint64_t>(st.st_size);
+    stamp.mtime = static_cast<int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+    stamp.inode = static_cast<uint64_t>(st.st_ino);
+    return true;
+}
+
+// The newest record of the key: the one furthest into the log. No locks, and
+// no system calls unless the record was appended after the file was mapped.
+bool RecordCache::find(RecordKind kind, const std::string &key, Record &record) const {
+    Generation *generation = generation_.load(std::memory_order_acquire);
+    record.offset = 0;
+    if (!generation) {
+        return false;
+    }
+    uint64_t hash = keyHash(static_cast<uint32_t>(kind), key.data(), key.size());
+    for (uint64_t i = 0; i <= generation->mask; i++) {
+        uint64_t slot = __atomic_load_n(&generation->slots[(hash + i) & generation->mask], __ATOMIC_ACQUIRE);
+        if (slot == 0) {
+            break;
+        }
+        Record candidate;
+        if ((slot & kSlotOffsetMask) << 3 > record.offset
+            && generation->readMatching(slot, hash, kind, key, candidate)) {
+            record = candidate;
+        }
+    }
+    return record.offset != 0;
+}
+
+// Reserves room at the end of the log, writes the record there and publishes
+// it in the first free slot of its probe sequence, after any older record of
+// the key. Neither step waits for other writers.
+void RecordCache::append(RecordKind kind, const std::string &key, const Stamp &stamp, const char *payload,
+                         size_t payloadSize) {
+    Generation *generation = writableGeneration();
+    if (!generation) {
+        return;
+    }
+    CacheHeader *header = generation->header;
+    if (__atomic_load_n(&header->usedSlots, __ATOMIC_RELAXED) >= (generation->mask + 1) / 4 * 3) {
+        dropped_ = true;
+        return;
+    }
+
+    RecordHeader recordHeader {static_cast<uint32_t>(kind), static_cast<uint32_t>(key.size()),
+                               static_cast<uint32_t>(payloadSize), 0, stamp.size, stamp.mtime, stamp.inode};
+    std::string record(reinterpret_cast<const char *>(&recordHeader), sizeof(recordHeader));
+    record.append(key);
+    record.append(payload, payloadSize);
+    record.resize((record.size() + 7) & ~size_t(7), '\0');
+    uint64_t offset = __atomic_fetch_add(&header->logEnd, record.size(), __ATOMIC_RELAXED);
+    if (offset + record.size() > kWindowSize || !writeAt(generation->fd, record.data(), record.size(), offset)) {
+        dropped_ = true;
+        return;
+    }
+
+    uint64_t hash = keyHash(static_cast<uint32_t>(kind), key.data(), key.size());
+    uint64_t entry = (hash & ~kSlotOffsetMask) | offset >> 3;
+    bool replaces = false;
+    for (uint64_t i = 0; i <= generation->mask; i++) {
+        uint64_t *slot = &generation->slots[(hash + i) & generation->mask];
+        uint64_t current = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (current == 0
+            && __atomic_compare_exchange_n(slot, &current, entry, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_add(&header->usedSlots, 1, __ATOMIC_RELAXED);
+            if (replaces) {
+                __atomic_fetch_add(&header->replacedSlots, 1, __ATOMIC_RELAXED);
+            }
+            return;
+        }
+        // Taken, possibly just now by another writer
+        Record older;
+        replaces = replaces || generation->readMatching(current, hash, kind, key, older);
+    }
+    dropped_ = true;
+}
+
+bool RecordCache::lookup(const std::string &file, std::vector<MachOInfo> &result) const {
+    Record record;
+    if (!find(RecordKind::File, file, record)) {
+        return false;
+    }
+    Stamp stamp;
+    if (!trusted(file) && (!stampOf(file, stamp) || !(stamp == record.stamp))) {
+        return false;
+    }
+    return decodeParseResult(record.payload, record.payloadSize, result);
+}
+
+void RecordCache::store(const std::string &file, const std::vector<MachOInfo> &result) {
+    Stamp stamp;
+    if (!generation_.load(std::memory_order_relaxed) || !stampOf(file, stamp)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stored_.insert(file);
+    }
+    std::string payload;
+    encodeParseResult(result, payload);
+    append(RecordKind::File, file, stamp, payload.data(), payload.size());
+}
+
+std::string RecordCache::hashKey(const std::string &file, uint64_t offset) {
+    return file + '\0' + std::to_string(offset);
+}
+
+bool RecordCache::lookupHash(const std::string &file, uint64_t offset, uint64_t &hash) const {
+    Record record;
+    if (!find(RecordKind::Hash, hashKey(file, offset), record) || record.payloadSize != sizeof(hash)) {
+        return false;
+    }
+    Stamp stamp;
+    if (!trusted(file) && (!stampOf(file, stamp) || !(stamp == record.stamp))) {
+        return false;
+    }
+    std::memcpy(&hash, record.payload, sizeof(hash));
+    return true;
+}
+
+void RecordCache::storeHash(const std::string &file, uint64_t offset, uint64_t hash) {
+    Stamp stamp;
+    if (!generation_.load(std::memory_order_relaxed) || !stampOf(file, stamp)) {
+        return;
+    }
+    append(RecordKind::Hash, hashKey(file, offset), stamp, reinterpret_cast<const char *>(&hash), sizeof(hash));
+}
+
+bool RecordCache::trusted(const std::string &file) const {
+    auto slash = file.rfind('/');
+    return slash != std::string::npos && trustedDirectories_.count(file.substr(0, slash));
+}
+
+bool RecordCache::trustedSize(const std::string &file, uint64_t &size) const {
+    Record record;
+    if (!trusted(file) || !find(RecordKind::File, file, record)) {
+        return false;
+    }
+    size = record.stamp.size;
+    return true;
+}
+
+std::vector<std::string> RecordCache::walk(const std::vector<std::string> &paths, bool verify) {
+    if (path_.empty()) {
+        return expandPaths(paths);
+    }
+    std::vector<std::string> files;
+    for (const auto &path : paths) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(path, error)) {
+            files.push_back(path);
+            continue;
+        }
+        walkDirectory(path, verify, files);
+    }
+    return files;
+}
+
+// Depth first and in directory order, like expandPaths(). Only directories
+// that changed are recorded again.
+void RecordCache::walkDirectory(const std::string &dir, bool verify, std::vector<std::string> &files) {
+    WalkedDirectory walked {};
+    if (!stampOf(dir, walked.stamp)) {
+        return;
+    }
+    bool unchanged = false;
+    Record recorded;
+    if (!verify && find(RecordKind::Directory, dir, recorded) && recorded.stamp == walked.stamp) {
+        Decoder decoder(recorded.payload, recorded.payloadSize);
+        for (uint32_t i = 0, count = decoder.count(5); decoder.ok() && i < count; i++) {
+            DirectoryEntry entry {};
+            decoder.get(entry.name);
+            decoder.get(entry.kind);
+            walked.entries.push_back(std::move(entry));
+        }
+        unchanged = decoder.ok() && decoder.atEnd();
+    }
+    if (unchanged) {
+        // Keyed the way trusted() finds the directory of a file
+        auto inside = (std::filesystem::path(dir) / ".").string();
+        trustedDirectories_.insert(inside.substr(0, inside.size() - 2));
+    } else {
+        walked.entries.clear();
+        std::error_code error;
+        auto options = std::filesystem::directory_options::skip_permission_denied;
+        for (std::filesystem::directory_iterator it(dir, options, error), end; !error && it != end;
+             it.increment(error)) {
+            if (it->is_symlink(error)) {
+                continue;
+            }
+            if (it->is_directory(error)) {
+                walked.entries.push_back({it->path().filename().string(), EntryKind::Directory});
+            } else if (it->is_regular_file(error)) {
+                walked.entries.push_back({it->path().filename().string(), EntryKind::Other});
+            }
+        }
+    }
+
+    for (const auto &entry : walked.entries) {
+        auto path = (std::filesystem::path(dir) / entry.name).string();
+        if (entry.kind == EntryKind::Directory) {
+            walkDirectory(path, verify, files);
+        } else if (!unchanged || entry.kind == EntryKind::Image) {
+            files.push_back(std::move(path));
+        }
+    }
+    if (!unchanged) {
+        walkedDirectories_[dir] = std::move(walked);
+    }
+}
+
+bool RecordCache::save() {
+    if (path_.empty()) {
+        return true;
+    }
+    // Directories that changed, with the kinds of their files as of now
+    std::string payload;
+    for (const auto &directory : walkedDirectories_) {
+        payload.clear();
+        Encoder encoder(payload);
+        encoder.put(static_cast<uint32_t>(directory.second.entries.size()));
+        for (const auto &entry : directory.second.entries) {
+            auto kind = entry.kind;
+            Record record;
+            if (kind != EntryKind::Directory) {
+                auto path = (std::filesystem::path(directory.first) / entry.name).string();
+                kind = stored_.count(path) || find(RecordKind::File, path, record) ? EntryKind::Image
+                                                                                  : EntryKind::Other;
+            }
+            encoder.put(entry.name);
+            encoder.put(kind);
+        }
+        append(RecordKind::Directory, directory.first, directory.second.stamp, payload.data(), payload.size());
+    }
+    walkedDirectories_.clear();
+
+    Generation *generation = writableGeneration();
+    if (!generation) {
+        return generation_.load() != nullptr;  // read-only caches are fine
+    }
+    uint64_t slotCount = generation->mask + 1;
+    uint64_t used = __atomic_load_n(&generation->header->usedSlots, __ATOMIC_RELAXED);
+    uint64_t replaced = __atomic_load_n(&generation->header->replacedSlots, __ATOMIC_RELAXED);
+    bool due = dropped_ || used > slotCount / 2 || (replaced > kMinSlotCount / 4 && replaced > used / 2);
+    return !due || compact(*generation);
+}
+
+// Writes the newest record of every key whose file is unchanged to a new file
+// with an index four times the size it needs, renames it over this one and
+// retires this one. Only one process compacts a file at a time; stores other
+// processes make to it in the meantime are lost.
+bool RecordCache::compact(Generation &generation) {
+    if (flock(generation.fd, LOCK_EX | LOCK_NB) != 0) {
+        return true;  // someone else is at it
+    }
+    struct stat current {}, ours {};
+    if (stat(path_.c_str(), &current) != 0 || fstat(generation.fd, &ours) != 0 || current.st_dev != ours.st_dev
+        || current.st_ino != ours.st_ino || __atomic_load_n(&generation.header->retired, __ATOMIC_ACQUIRE)) {
+        flock(generation.fd, LOCK_UN);
+        return true;  // already replaced
+    }
+
+    std::unordered_map<std::string, Record> newest;  // by kind and key
+    for (uint64_t i = 0; i <= generation.mask; i++) {
+        uint64_t slot = __atomic_load_n(&generation.slots[i], __ATOMIC_ACQUIRE);
+        Record record;
+        if (slot == 0 || !generation.read((slot & kSlotOffsetMask) << 3, record)) {
+            continue;
+        }
+        std::string key(reinterpret_cast<const char *>(&record.kind), sizeof(record.kind));
+        key.append(record.key, record.keySize);
+        auto &kept = newest[key];
+        if (record.offset > kept.offset) {
+            kept = record;
+        }
+    }
+    // Files below unchanged directories are not looked at again
+    std::vector<Record> live;
+    for (const auto &entry : newest) {
+        const auto &record = entry.second;
+        std::string file(record.key, record.keySize);
+        if (record.kind == RecordKind::Hash) {
+            file.resize(std::strlen(file.c_str()));  // up to the NUL before the offset
+        }
+        Stamp stamp;
+        if ((record.kind == RecordKind::Directory || !trusted(file))
+            && (!stampOf(file, stamp) || !(stamp == record.stamp))) {
+            continue;
+        }
+        live.push_back(record);
+    }
+    std::sort(live.begin(), live.end(), [](const Record &a, const Record &b) { return a.offset < b.offset; });
+
+    uint64_t slotCount = kMinSlotCount;
+    while (slotCount < live.size() * 4) {
+        slotCount *= 2;
+    }
+    uint64_t logStart = kHeaderSize + slotCount * sizeof(uint64_t);
+    std::vector<uint64_t> slots(slotCount);
+    std::string log;
+    for (const auto &record : live) {
+        uint64_t hash = keyHash(static_cast<uint32_t>(record.kind), record.key, record.keySize);
+        uint64_t index = hash;
+        while (slots[index & (slotCount - 1)] != 0) {
+            index++;
+        }
+        slots[index & (slotCount - 1)] = (hash & ~kSlotOffsetMask) | (logStart + log.size()) >> 3;
+        log.append(generation.data + record.offset, record.size);
+    }
+    auto header = cacheHeader(slotCount, logStart + log.size(), live.size());
+
+    AtomicFile out(path_, 0644);
+    bool ok = out.fd() >= 0 && writeAt(out.fd(), &header, sizeof(header), 0)
+        && writeAt(out.fd(), slots.data(), slots.size() * sizeof(uint64_t), kHeaderSize)
+        && writeAt(out.fd(), log.data(), log.size(), logStart) && out.commit();
+    if (ok) {
+        __atomic_store_n(&generation.header->retired, 1, __ATOMIC_RELEASE);
+    }
+    flock(generation.fd, LOCK_UN);
+    return ok;
+}
+
+std::vector<MachOInfo> parseMachOCached(const std::string &filename, RecordCache *cache, std::ostream &out,
+                                        TaskPool *pool) {
+    std::vector<MachOInfo> result;
+    if (cache && cache->lookup(filename, result)) {
+        return result;
+    }
+    result = parseMachO(filename, out, pool);
+    if (cache && !result.empty()) {
+        cache->store(filename, result);
+    }
+    return result;
+}
@@ -0,0 +1,146 @@
+#ifndef MACDEPENDENCY_RECORD_CACHE_H
+#define MACDEPENDENCY_RECORD_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "macho_parser.h"
+
+
+// Binary encoding of a parse result, as stored in the cache file.
+// decodeParseResult() returns false on truncated or malformed data.
+void encodeParseResult(const std::vector<MachOInfo> &result, std::string &out);
+bool decodeParseResult(const char *data, size_t size, std::vector<MachOInfo> &result);
+
+// Parse results of files from earlier runs, so that the thousands of stubs of
+// an SDK are not parsed again every time. An entry is used only while the
+// file still has the size, modification time and inode it had when parsed.
+//
+// Many processes may share one cache file. Records are appended to a log at
+// the end of the file, and published in an open-addressing index of slots
+// mapped from its start; a slot is claimed with a compare-and-swap, so
+// writers never lock, and readers never wait: a lookup probes the mapped
+// index and decodes straight from the mapped log. The newest record of a key
+// wins. lookup() and store() may be called from several threads. save()
+// compacts the file once the index fills up or is mostly stale: the live
+// records go to a new file that is renamed into place, and the old one is
+// marked retired so that processes still using it move over. The cache is
+// best effort: a store racing a compaction, or finding the index full, is
+// dropped. A cache with an empty path does nothing.
+//
+// The cache also keeps the entries of every directory walk() went through,
+// with its stamp. A directory whose stamp is unchanged has the same entries,
+// since creating, removing or renaming one changes its mtime. Its listing then
+// comes from the cache, and its files are trusted without a stat() of their
+// own. Subdirectories are still visited, each for one stat(). A file
+// rewritten in place keeps its directory's stamp, so its cached entry is used
+// as it is until walk() runs with `verify`.
+class RecordCache {
+public:
+    // Reports to `out` when the path names a file that is not a cache; that
+    // file is left alone, and the cache does nothing.
+    RecordCache(std::string path, std::ostream &out);
+    ~RecordCache();
+
+    RecordCache(const RecordCache &) = delete;
+    RecordCache &operator=(const RecordCache &) = delete;
+
+    bool lookup(const std::string &file, std::vector<MachOInfo> &result) const;
+    void store(const std::string &file, const std::vector<MachOInfo> &result);
+
+    // Content hashes of slices (hashFileRange() of the slice), kept and
+    // checked against their file like parse results.
+    bool lookupHash(const std::string &file, uint64_t offset, uint64_t &hash) const;
+    void storeHash(const std::string &file, uint64_t offset, uint64_t hash);
+
+    // expandPaths(), through the cache: every directory costs one stat(), and
+    // only directories that changed are read. Files below unchanged
+    // directories that were not Mach-O files or text stubs last time are left
+    // out. With `verify`, every directory is read and every file checked
+    // again. Not thread-safe; walk before looking anything up.
+    std::vector<std::string> walk(const std::vector<std::string> &paths, bool verify);
+
+    // Size of a file below an unchanged directory, as the cache has it.
+    bool trustedSize(const std::string &file, uint64_t &size) const;
+
+    // Records the directories walked, and compacts the cache file if it is
+    // due. Returns false if the file could not be opened or rewritten.
+    bool save();
+
+private:
+    struct Stamp {
+        uint64_t size = 0;
+        int64_t mtime = 0;   // nanoseconds
+        uint64_t inode = 0;
+
+        bool operator==(const Stamp &other) const {
+            return size == other.size && mtime == other.mtime && inode == other.inode;
+        }
+    };
+
+    enum class RecordKind : uint32_t {
+        File = 1,       // parse result
+        Directory = 2,  // walk() listing
+        Hash = 3,       // slice hash, keyed by hashKey()
+    };
+    struct Record {
+        uint64_t offset = 0;  // in the log; 0 for none
+        uint64_t size = 0;    // of the whole record
+        RecordKind kind {};
+        Stamp stamp;
+        const char *key = nullptr;
+        uint32_t keySize = 0;
+        const char *payload = nullptr;
+        uint32_t payloadSize = 0;
+    };
+    struct Generation;  // one mapped cache file
+
+    // Files are images if they were stored, or had a record, when the cache was saved
+    enum class EntryKind : uint8_t {
+        Directory,
+        Image,
+        Other,
+    };
+    struct DirectoryEntry {
+        std::string name;
+        EntryKind kind;
+    };
+    struct WalkedDirectory {
+        Stamp stamp;
+        std::vector<DirectoryEntry> entries;
+    };
+
+    static bool stampOf(const std::string &file, Stamp &stamp);
+    static std::string hashKey(const std::string &file, uint64_t offset);
+    std::unique_ptr<Generation> openGeneration(bool &foreign) const;
+    Generation *writableGeneration();
+    bool find(RecordKind kind, const std::string &key, Record &record) const;
+    void append(RecordKind kind, const std::string &key, const Stamp &stamp, const char *payload, size_t payloadSize);
+    bool compact(Generation &generation);
+    bool trusted(const std::string &file) const;
+    void walkDirectory(const std::string &dir, bool verify, std::vector<std::string> &files);
+
+    std::string path_;
+    std::atomic<Generation *> generation_ {nullptr};
+    std::mutex mutex_;  // guards opening generations and stored_
+    std::vector<std::unique_ptr<Generation>> generations_;  // kept mapped until destruction
+    std::unordered_set<std::string> stored_;  // files parsed in this run, whether or not the store made it
+    std::atomic<bool> dropped_ {false};  // a store did not make it into the index
+    std::unordered_map<std::string, WalkedDirectory> walkedDirectories_;  // changed since the last walk
+    std::unordered_set<std::string> trustedDirectories_;  // unchanged since the cache was saved
+};
+
+// parseMachO() through the cache. Files that are not Mach-O or text stubs are
+// never cached, so their diagnostics are always reported.
+std::vector<MachOInfo> parseMachOCached(const std::string &filename, RecordCache *cache, std::ostream &out,
+                                        TaskPool *pool = nullptr);
+
+#endif // MACDEPENDENCY_RECORD_CACHE_H
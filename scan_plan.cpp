@@ -0,0 +1,86 @@
+#include "scan_plan.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "parallel.h"
+
+
+// Cost of a file beyond its size: opening it and parsing its headers
+static constexpr uint64_t kFileOverhead = 64 * 1024;
+// Batches stay small enough to balance, at several tasks per thread
+static constexpr uint64_t kMaxBatchCost = 4 * 1024 * 1024;
+static constexpr uint64_t kTasksPerJob = 8;
+// Files from this size on always get subtasks
+static constexpr uint64_t kSplitSize = 64 * 1024 * 1024;
+
+static uint64_t fileSize(const std::string &path);
+
+
+// IMPLEMENTATION BELOW
+
+static uint64_t fileSize(const std::string &path) {
+#if defined(__linux__) && defined(STATX_SIZE)
+    // Only the size is asked for, and not synced with the server on network file systems
+    struct statx stx {};
+    if (statx(AT_FDCWD, path.c_str(), AT_STATX_DONT_SYNC, STATX_SIZE, &stx) == 0 && (stx.stx_mask & STATX_SIZE)) {
+        return stx.stx_size;
+    }
+    return 0;
+#else
+    struct stat st {};
+    return stat(path.c_str(), &st) == 0 && st.st_size > 0 ? static_cast<uint64_t>(st.st_size) : 0;
+#endif
+}
+
+std::vector<uint64_t> scanFileSizes(const std::vector<std::string> &files, unsigned jobs, const RecordCache *cache) {
+    std::vector<uint64_t> sizes(files.size());
+    parallelFor(files.size(), jobs, [&](size_t i) {
+        if (!cache || !cache->trustedSize(files[i], sizes[i])) {
+            sizes[i] = fileSize(files[i]);
+        }
+    });
+    return sizes;
+}
+
+std::vector<ScanTask> planScan(const std::vector<uint64_t> &sizes, unsigned jobs) {
+    jobs = std::max(jobs, 1u);
+    uint64_t total = 0;
+    for (auto size : sizes) {
+        total += kFileOverhead + size;
+    }
+    uint64_t share = total / jobs;
+    uint64_t batchLimit = std::min(kMaxBatchCost, share / kTasksPerJob);
+
+    std::vector<ScanTask> tasks;
+    ScanTask batch;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        uint64_t cost = kFileOverhead + sizes[i];
+        if (cost >= batchLimit) {
+            ScanTask task;
+            task.files.push_back(i);
+            task.cost = cost;
+            // More than a thread's share cannot finish in time on one thread
+            task.split = sizes[i] >= kSplitSize || (jobs > 1 && cost > share);
+            tasks.push_back(std::move(task));
+            continue;
+        }
+        batch.files.push_back(i);
+        batch.cost += cost;
+        if (batch.cost >= batchLimit) {
+            tasks.push_back(std::move(batch));
+            batch = ScanTask {};
+        }
+    }
+    if (!batch.files.empty()) {
+        tasks.push_back(std::move(batch));
+    }
+
+    // Longest processing time first
+    std::stable_sort(tasks.begin(), tasks.end(), [](const ScanTask &a, const ScanTask &b) {
+        return a.cost > b.cost;
+    });
+    return tasks;
+}
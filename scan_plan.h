@@ -0,0 +1,32 @@
+#ifndef MACDEPENDENCY_SCAN_PLAN_H
+#define MACDEPENDENCY_SCAN_PLAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "record_cache.h"
+
+
+// One task of a scan: a file large enough to be a task of its own, or a batch
+// of small files that are not worth a task each.
+struct ScanTask {
+    std::vector<size_t> files;  // indices into the scanned list, in list order
+    uint64_t cost = 0;
+    // Large enough that its slices and fileset entries should be subtasks
+    bool split = false;
+};
+
+// Sizes of the files, from statx() where there is one, stat() otherwise, on
+// up to `jobs` threads. Files that cannot be stat'ed count as empty. Sizes of
+// files the cache trusts come from the cache.
+std::vector<uint64_t> scanFileSizes(const std::vector<std::string> &files, unsigned jobs,
+                                    const RecordCache *cache = nullptr);
+
+// Groups files into tasks for `jobs` threads and orders the tasks longest
+// first, so no large file is started last and holds up the end of the scan.
+// A file costs a fixed overhead plus its size.
+std::vector<ScanTask> planScan(const std::vector<uint64_t> &sizes, unsigned jobs);
+
+#endif // MACDEPENDENCY_SCAN_PLAN_H
@@ -0,0 +1,29 @@
+#ifndef MACDEPENDENCY_SHA256_H
+#define MACDEPENDENCY_SHA256_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+using Sha256Digest = std::array<uint8_t, 32>;
+
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void *data, size_t size);
+    Sha256Digest finish();
+
+    static Sha256Digest hash(const void *data, size_t size);
+
+private:
+    void compress(const uint8_t *block);
+
+    uint32_t state_[8];
+    uint8_t buffer_[64];
+    size_t buffered_ = 0;
+    uint64_t length_ = 0;
+};
+
+#endif // MACDEPENDENCY_SHA256_H
@@ -0,0 +1,338 @@
+#include "simd_kernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MACDEPENDENCY_SIMD_X86 1
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx512dq")))
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define MACDEPENDENCY_SIMD_NEON 1
+#endif
+
+
+static constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+static constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+
+static size_t boundedLengthScalar(const char *data, size_t max);
+static void byteSwap32Scalar(uint32_t *words, size_t count);
+static const char *findBytesScalar(const char *haystack, size_t size, const char *needle, size_t needleSize);
+static void hashStripesScalar(uint64_t accumulators[4], const unsigned char *data, size_t stripes);
+static const char *findCandidates(uint64_t mask, const char *block, const char *needle, size_t needleSize);
+static const SimdKernels *chooseKernels();
+
+static const SimdKernels kScalarKernels {
+    "scalar", boundedLengthScalar, byteSwap32Scalar, findBytesScalar, hashStripesScalar,
+};
+
+
+// IMPLEMENTATION BELOW
+
+static size_t boundedLengthScalar(const char *data, size_t max) {
+    size_t length = 0;
+    while (length < max && data[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+static void byteSwap32Scalar(uint32_t *words, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        words[i] = __builtin_bswap32(words[i]);
+    }
+}
+
+static const char *findBytesScalar(const char *haystack, size_t size, const char *needle, size_t needleSize) {
+    if (needleSize == 0) {
+        return haystack;
+    }
+    for (size_t i = 0; i + needleSize <= size; i++) {
+        if (haystack[i] == needle[0] && std::memcmp(haystack + i, needle, needleSize) == 0) {
+            return haystack + i;
+        }
+    }
+    return nullptr;
+}
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static void hashStripesScalar(uint64_t accumulators[4], const unsigned char *data, size_t stripes) {
+    for (size_t stripe = 0; stripe < stripes; stripe++, data += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t input;
+            std::memcpy(&input, data + lane * 8, sizeof(input));
+            accumulators[lane] = rotateLeft(accumulators[lane] + input * kPrime2, 31) * kPrime1;
+        }
+    }
+}
+
+// Positions whose first and last byte match the needle's, one bit each in
+// `mask`, are compared in full. Vector variants find the candidates.
+static const char *findCandidates(uint64_t mask, const char *block, const char *needle, size_t needleSize) {
+    while (mask != 0) {
+        int bit = __builtin_ctzll(mask);
+        if (std::memcmp(block + bit, needle, needleSize) == 0) {
+            return block + bit;
+        }
+        mask &= mask - 1;
+    }
+    return nullptr;
+}
+
+#ifdef MACDEPENDENCY_SIMD_X86
+
+TARGET_SSE42 static size_t boundedLengthSse42(const char *data, size_t max) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= max; i += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + boundedLengthScalar(data + i, max - i);
+}
+
+TARGET_SSE42 static void byteSwap32Sse42(uint32_t *words, size_t count) {
+    const __m128i shuffle = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(words + i), _mm_shuffle_epi8(block, shuffle));
+    }
+    byteSwap32Scalar(words + i, count - i);
+}
+
+TARGET_SSE42 static const char *findBytesSse42(const char *haystack, size_t size, const char *needle,
+                                               size_t needleSize) {
+    if (needleSize == 0 || needleSize > size) {
+        return findBytesScalar(haystack, size, needle, needleSize);
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleSize - 1]);
+    size_t i = 0;
+    for (; i + needleSize - 1 + 16 <= size; i += 16) {
+        auto blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i));
+        auto blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i + needleSize - 1));
+        auto matches = _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+        if (auto found = findCandidates(mask, haystack + i, needle, needleSize)) {
+            return found;
+        }
+    }
+    return findBytesScalar(haystack + i, size - i, needle, needleSize);
+}
+
+TARGET_AVX2 static size_t boundedLengthAvx2(const char *data, size_t max) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= max; i += 32) {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + boundedLengthSse42(data + i, max - i);
+}
+
+TARGET_AVX2 static void byteSwap32Avx2(uint32_t *words, size_t count) {
+    const __m256i shuffle = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                             3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(words + i), _mm256_shuffle_epi8(block, shuffle));
+    }
+    byteSwap32Sse42(words + i, count - i);
+}
+
+TARGET_AVX2 static const char *findBytesAvx2(const char *haystack, size_t size, const char *needle,
+                                             size_t needleSize) {
+    if (needleSize == 0 || needleSize > size) {
+        return findBytesScalar(haystack, size, needle, needleSize);
+    }
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleSize - 1]);
+    size_t i = 0;
+    for (; i + needleSize - 1 + 32 <= size; i += 32) {
+        auto blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i));
+        auto blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i + needleSize - 1));
+        auto matches = _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(matches));
+        if (auto found = findCandidates(mask, haystack + i, needle, needleSize)) {
+            return found;
+        }
+    }
+    return findBytesSse42(haystack + i, size - i, needle, needleSize);
+}
+
+TARGET_AVX512 static size_t boundedLengthAvx512(const char *data, size_t max) {
+    const __m512i zero = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 64 <= max; i += 64) {
+        auto block = _mm512_loadu_si512(data + i);
+        uint64_t mask = _mm512_cmpeq_epi8_mask(block, zero);
+        if (mask != 0) {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return i + boundedLengthAvx2(data + i, max - i);
+}
+
+TARGET_AVX512 static void byteSwap32Avx512(uint32_t *words, size_t count) {
+    const __m512i shuffle = _mm512_set4_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto block = _mm512_loadu_si512(words + i);
+        _mm512_storeu_si512(words + i, _mm512_shuffle_epi8(block, shuffle));
+    }
+    byteSwap32Avx2(words + i, count - i);
+}
+
+TARGET_AVX512 static const char *findBytesAvx512(const char *haystack, size_t size, const char *needle,
+                                                 size_t needleSize) {
+    if (needleSize == 0 || needleSize > size) {
+        return findBytesScalar(haystack, size, needle, needleSize);
+    }
+    const __m512i first = _mm512_set1_epi8(needle[0]);
+    const __m512i last = _mm512_set1_epi8(needle[needleSize - 1]);
+    size_t i = 0;
+    for (; i + needleSize - 1 + 64 <= size; i += 64) {
+        auto blockFirst = _mm512_loadu_si512(haystack + i);
+        auto blockLast = _mm512_loadu_si512(haystack + i + needleSize - 1);
+        uint64_t mask = _mm512_cmpeq_epi8_mask(blockFirst, first) & _mm512_cmpeq_epi8_mask(blockLast, last);
+        if (auto found = findCandidates(mask, haystack + i, needle, needleSize)) {
+            return found;
+        }
+    }
+    return findBytesAvx2(haystack + i, size - i, needle, needleSize);
+}
+
+// The four accumulators are the four lanes of one register
+TARGET_AVX512 static void hashStripesAvx512(uint64_t accumulators[4], const unsigned char *data, size_t stripes) {
+    const __m256i prime1 = _mm256_set1_epi64x(static_cast<long long>(kPrime1));
+    const __m256i prime2 = _mm256_set1_epi64x(static_cast<long long>(kPrime2));
+    auto lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(accumulators));
+    for (size_t stripe = 0; stripe < stripes; stripe++, data += 32) {
+        auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        lanes = _mm256_add_epi64(lanes, _mm256_mullo_epi64(input, prime2));
+        lanes = _mm256_mullo_epi64(_mm256_rol_epi64(lanes, 31), prime1);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(accumulators), lanes);
+}
+
+static const SimdKernels kSse42Kernels {
+    "sse4.2", boundedLengthSse42, byteSwap32Sse42, findBytesSse42, hashStripesScalar,
+};
+static const SimdKernels kAvx2Kernels {
+    "avx2", boundedLengthAvx2, byteSwap32Avx2, findBytesAvx2, hashStripesScalar,
+};
+static const SimdKernels kAvx512Kernels {
+    "avx512", boundedLengthAvx512, byteSwap32Avx512, findBytesAvx512, hashStripesAvx512,
+};
+
+static bool hasAvx512() {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+           && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512dq");
+}
+
+std::vector<const SimdKernels *> availableSimdKernels() {
+    __builtin_cpu_init();
+    std::vector<const SimdKernels *> kernels {&kScalarKernels};
+    if (__builtin_cpu_supports("sse4.2")) {
+        kernels.push_back(&kSse42Kernels);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back(&kAvx2Kernels);
+    }
+    if (hasAvx512()) {
+        kernels.push_back(&kAvx512Kernels);
+    }
+    return kernels;
+}
+
+#elif defined(MACDEPENDENCY_SIMD_NEON)
+
+// One bit in four per byte: NEON has no movemask, but narrowing the 0x00/0xff
+// bytes by four bits leaves a nibble per byte in a 64-bit word.
+static inline uint64_t nibbleMask(uint8x16_t matches) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+}
+
+static size_t boundedLengthNeon(const char *data, size_t max) {
+    size_t i = 0;
+    for (; i + 16 <= max; i += 16) {
+        auto block = vld1q_u8(reinterpret_cast<const uint8_t *>(data + i));
+        uint64_t mask = nibbleMask(vceqzq_u8(block));
+        if (mask != 0) {
+            return i + __builtin_ctzll(mask) / 4;
+        }
+    }
+    return i + boundedLengthScalar(data + i, max - i);
+}
+
+static void byteSwap32Neon(uint32_t *words, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto block = vld1q_u8(reinterpret_cast<const uint8_t *>(words + i));
+        vst1q_u8(reinterpret_cast<uint8_t *>(words + i), vrev32q_u8(block));
+    }
+    byteSwap32Scalar(words + i, count - i);
+}
+
+static const char *findBytesNeon(const char *haystack, size_t size, const char *needle, size_t needleSize) {
+    if (needleSize == 0 || needleSize > size) {
+        return findBytesScalar(haystack, size, needle, needleSize);
+    }
+    const uint8x16_t first = vdupq_n_u8(static_cast<uint8_t>(needle[0]));
+    const uint8x16_t last = vdupq_n_u8(static_cast<uint8_t>(needle[needleSize - 1]));
+    size_t i = 0;
+    for (; i + needleSize - 1 + 16 <= size; i += 16) {
+        auto blockFirst = vld1q_u8(reinterpret_cast<const uint8_t *>(haystack + i));
+        auto blockLast = vld1q_u8(reinterpret_cast<const uint8_t *>(haystack + i + needleSize - 1));
+        // Keep the low bit of each nibble, then one bit per byte for findCandidates()
+        uint64_t nibbles = nibbleMask(vandq_u8(vceqq_u8(blockFirst, first), vceqq_u8(blockLast, last)));
+        nibbles &= 0x1111111111111111ULL;
+        uint64_t mask = 0;
+        for (; nibbles != 0; nibbles &= nibbles - 1) {
+            mask |= 1ULL << (__builtin_ctzll(nibbles) / 4);
+        }
+        if (auto found = findCandidates(mask, haystack + i, needle, needleSize)) {
+            return found;
+        }
+    }
+    return findBytesScalar(haystack + i, size - i, needle, needleSize);
+}
+
+static const SimdKernels kNeonKernels {
+    "neon", boundedLengthNeon, byteSwap32Neon, findBytesNeon, hashStripesScalar,
+};
+
+std::vector<const SimdKernels *> availableSimdKernels() {
+    // NEON is part of every arm64 CPU
+    return {&kScalarKernels, &kNeonKernels};
+}
+
+#else
+
+std::vector<const SimdKernels *> availableSimdKernels() {
+    return {&kScalarKernels};
+}
+
+#endif
+
+static const SimdKernels *chooseKernels() {
+    return availableSimdKernels().back();
+}
+
+const SimdKernels &simdKernels() {
+    static const SimdKernels *chosen = chooseKernels();
+    return *chosen;
+}
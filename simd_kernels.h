@@ -0,0 +1,37 @@
+#ifndef MACDEPENDENCY_SIMD_KERNELS_H
+#define MACDEPENDENCY_SIMD_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Inner loops that have vector versions. Every variant computes exactly what
+// the scalar one does; simd_kernels_test compares them on this machine.
+struct SimdKernels {
+    const char *name;
+
+    // strnlen(): length of the string at `data`, at most `max`. Never reads
+    // past data + max.
+    size_t (*boundedLength)(const char *data, size_t max);
+
+    // Reverses the byte order of `count` 32-bit words in place.
+    void (*byteSwap32)(uint32_t *words, size_t count);
+
+    // memmem(): the first occurrence of `needle` in `haystack`, or nullptr.
+    const char *(*findBytes)(const char *haystack, size_t size, const char *needle, size_t needleSize);
+
+    // The XXH64 stripe loop: `stripes` times 32 bytes into the four
+    // accumulators. Only AVX-512 has the 64-bit vector multiply this needs;
+    // other variants use the scalar loop.
+    void (*hashStripes)(uint64_t accumulators[4], const unsigned char *data, size_t stripes);
+};
+
+// The fastest variant the CPU supports, chosen on first use: AVX-512
+// (F, BW, VL and DQ), AVX2 or SSE4.2 on x86, NEON on arm64, scalar otherwise.
+const SimdKernels &simdKernels();
+
+// Every variant this CPU can run, scalar first.
+std::vector<const SimdKernels *> availableSimdKernels();
+
+#endif // MACDEPENDENCY_SIMD_KERNELS_H
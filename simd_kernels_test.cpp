@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "number_parser.h"
+#include "simd_kernels.h"
+
+static constexpr uint64_t kDefaultRounds = 2000;
+
+// Runs every kernel variant this CPU supports against the scalar one on random
+// inputs. Usage: simd_kernels_test [<rounds>]. Exits with 1 when one differs.
+int main(int argc, char **argv) {
+    uint64_t rounds = kDefaultRounds;
+    if (argc > 2 || (argc == 2 && !parseUnsigned(argv[1], rounds))) {
+        std::cerr << "Usage: " << argv[0] << " [<rounds>]\n";
+        return 1;
+    }
+
+    // Random lengths and start offsets, so that every variant goes through its
+    // vector loop, its tail and unaligned loads. Bytes come from a small
+    // alphabet with NULs, so that searches find something.
+    std::mt19937_64 random(0x6d61636465705eULL);
+    auto below = [&](size_t bound) { return static_cast<size_t>(random() % bound); };
+    std::vector<char> buffer(1024);
+    std::vector<uint32_t> words(96);
+    auto kernels = availableSimdKernels();
+    const auto &scalar = *kernels.front();
+
+    std::cout << "selected: " << simdKernels().name << '\n';
+    bool mismatch = false;
+    for (const auto *kernel : kernels) {
+        std::string failed;
+        for (uint64_t round = 0; round < rounds && failed.empty(); round++) {
+            for (auto &byte : buffer) {
+                byte = below(16) == 0 ? '\0' : static_cast<char>('a' + below(4));
+            }
+            size_t offset = below(64);
+            size_t size = below(buffer.size() - offset);
+            const char *data = buffer.data() + offset;
+
+            if (kernel->boundedLength(data, size) != scalar.boundedLength(data, size)) {
+                failed = "boundedLength";
+            }
+
+            size_t needleSize = 1 + below(12);
+            std::string needle;
+            if (size >= needleSize && below(4) != 0) {
+                needle.assign(data + below(size - needleSize + 1), needleSize);
+            } else {
+                for (size_t i = 0; i < needleSize; i++) {
+                    needle += static_cast<char>('a' + below(4));
+                }
+            }
+            if (kernel->findBytes(data, size, needle.data(), needle.size())
+                != scalar.findBytes(data, size, needle.data(), needle.size())) {
+                failed = "findBytes";
+            }
+
+            size_t first = below(8);
+            size_t count = below(words.size() - first);
+            for (auto &word : words) {
+                word = static_cast<uint32_t>(random());
+            }
+            auto expected = words;
+            kernel->byteSwap32(words.data() + first, count);
+            scalar.byteSwap32(expected.data() + first, count);
+            if (words != expected) {
+                failed = "byteSwap32";
+            }
+
+            uint64_t lanes[4], expectedLanes[4];
+            for (int i = 0; i < 4; i++) {
+                lanes[i] = expectedLanes[i] = random();
+            }
+            auto bytes = reinterpret_cast<const unsigned char *>(buffer.data()) + offset;
+            size_t stripes = below((buffer.size() - offset) / 32 + 1);
+            kernel->hashStripes(lanes, bytes, stripes);
+            scalar.hashStripes(expectedLanes, bytes, stripes);
+            if (!std::equal(lanes, lanes + 4, expectedLanes)) {
+                failed = "hashStripes";
+            }
+        }
+        std::cout << kernel->name << ": " << (failed.empty() ? "ok" : "mismatch in " + failed) << '\n';
+        mismatch |= !failed.empty();
+    }
+    return mismatch ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+#include "symbol_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <mach-o/nlist.h>
+
+
+// The part of a slice that is actually in the file. Ranges taken from load
+// commands are checked against it before anything is allocated, so a
+// malformed one fails the image instead of asking for gigabytes.
+struct SliceRange {
+    uint64_t offset;
+    uint64_t size;
+};
+
+static bool readRange(std::ifstream &file, const SliceRange &slice, uint64_t offset, uint64_t size,
+                      std::vector<char> &buffer) {
+    if (offset > slice.size || size > slice.size - offset) {
+        return false;
+    }
+    buffer.resize(size);
+    file.seekg(static_cast<std::streamoff>(slice.offset + offset));
+    file.read(buffer.data(), static_cast<std::streamsize>(size));
+    return static_cast<uint64_t>(file.gcount()) == size;
+}
+
+static bool readUleb128(const char *&p, const char *end, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        auto byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Walks the export trie depth first, building each name from the edge labels.
+static bool walkExportsTrie(const std::vector<char> &trie, std::vector<std::string> &symbols) {
+    struct Pending {
+        uint64_t offset;
+        std::string prefix;
+    };
+    std::vector<Pending> stack {{0, {}}};
+    std::vector<bool> visited(trie.size(), false);
+    const char *begin = trie.data();
+    const char *end = begin + trie.size();
+
+    while (!stack.empty()) {
+        auto node = std::move(stack.back());
+        stack.pop_back();
+        if (node.offset >= trie.size() || visited[node.offset]) {
+            return false;  // malformed, or a cycle
+        }
+        visited[node.offset] = true;
+
+        const char *p = begin + node.offset;
+        uint64_t terminalSize;
+        if (!readUleb128(p, end, terminalSize) || terminalSize > static_cast<uint64_t>(end - p)) {
+            return false;
+        }
+        if (terminalSize != 0) {
+            const char *terminal = p;
+            uint64_t flags;
+            if (readUleb128(terminal, p + terminalSize, flags) && !(flags & EXPORT_SYMBOL_FLAGS_REEXPORT)) {
+                symbols.push_back(node.prefix);
+            }
+        }
+        p += terminalSize;
+
+        if (p >= end) {
+            return false;
+        }
+        auto childCount = static_cast<uint8_t>(*p++);
+        for (uint8_t i = 0; i < childCount; i++) {
+            auto labelEnd = static_cast<const char *>(std::memchr(p, '\0', end - p));
+            if (!labelEnd) {
+                return false;
+            }
+            std::string name = node.prefix;
+            name.append(p, labelEnd);
+            p = labelEnd + 1;
+            uint64_t childOffset;
+            if (!readUleb128(p, end, childOffset)) {
+                return false;
+            }
+            stack.push_back({childOffset, std::move(name)});
+        }
+    }
+    return true;
+}
+
+template <bool is64Bit>
+static bool readSymbolTable(std::ifstream &file, const SliceRange &range, const MachOInfo &slice,
+                            std::vector<std::string> &symbols) {
+    using NlistType = typename std::conditional<is64Bit, struct nlist_64, struct nlist>::type;
+    std::vector<char> entries;
+    std::vector<char> strings;
+    if (!readRange(file, range, slice.symtab_offset, static_cast<uint64_t>(slice.symtab_count) * sizeof(NlistType),
+                   entries)
+        || !readRange(file, range, slice.strtab_offset, slice.strtab_size, strings)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < slice.symtab_count; i++) {
+        NlistType entry;
+        std::memcpy(&entry, entries.data() + i * sizeof(NlistType), sizeof(NlistType));
+        if ((entry.n_type & N_STAB) || !(entry.n_type & N_EXT) || (entry.n_type & N_PEXT)) {
+            continue;
+        }
+        auto type = entry.n_type & N_TYPE;
+        if (type != N_SECT && type != N_ABS) {
+            continue;
+        }
+        auto offset = entry.n_un.n_strx;
+        if (offset >= strings.size()) {
+            continue;
+        }
+        auto name = strings.data() + offset;
+        symbols.emplace_back(name, strnlen(name, strings.size() - offset));
+    }
+    return true;
+}
+
+bool readExportedSymbols(const std::string &path, const MachOInfo &slice, std::vector<std::string> &symbols) {
+    if (slice.text_stub) {
+        symbols.insert(symbols.end(), slice.exports.begin(), slice.exports.end());
+        return true;
+    }
+    std::ifstream file(path, std::ios::binary | std::ios::in);
+    if (!file.is_open() || !file.seekg(0, std::ios::end)) {
+        return false;
+    }
+    auto fileSize = static_cast<uint64_t>(file.tellg());
+    SliceRange range {slice.offset, fileSize > slice.offset ? fileSize - slice.offset : 0};
+    if (slice.size != 0) {
+        range.size = std::min(range.size, slice.size);
+    }
+
+    if (slice.exports_trie_size != 0) {
+        std::vector<char> trie;
+        return readRange(file, range, slice.exports_trie_offset, slice.exports_trie_size, trie)
+               && walkExportsTrie(trie, symbols);
+    }
+    if (slice.symtab_count == 0) {
+        return true;
+    }
+    if (slice.is_64_bit) {
+        return readSymbolTable<true>(file, range, slice, symbols);
+    }
+    return readSymbolTable<false>(file, range, slice, symbols);
+}
@@ -0,0 +1,17 @@
+#ifndef MACDEPENDENCY_SYMBOL_READER_H
+#define MACDEPENDENCY_SYMBOL_READER_H
+
+#include <string>
+#include <vector>
+
+#include "macho_parser.h"
+
+
+// Reads the names of the symbols a slice defines and exports, from the export
+// trie when it has one and from the external entries of LC_SYMTAB otherwise.
+// Re-exports are left out, since the definition lives in another image.
+// Text stubs come with their symbols already listed.
+// Returns false if the slice's __LINKEDIT data cannot be read.
+bool readExportedSymbols(const std::string &path, const MachOInfo &slice, std::vector<std::string> &symbols);
+
+#endif // MACDEPENDENCY_SYMBOL_READER_H
@@ -0,0 +1,81 @@
+#include "task_pool.h"
+
+#include <utility>
+
+
+TaskPool::TaskPool(unsigned jobs) {
+    for (unsigned i = 1; i < jobs; i++) {
+        workers_.emplace_back(&TaskPool::workerLoop, this);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+void TaskPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        auto task = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+TaskGroup::TaskGroup(TaskPool *pool)
+    : pool_(pool && !pool->workers_.empty() ? pool : nullptr) {
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    if (!pool_) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool_->mutex_);
+        pending_++;
+        pool_->queue_.emplace_back([this, task = std::move(task)]() {
+            task();
+            std::lock_guard<std::mutex> lock(pool_->mutex_);
+            if (--pending_ == 0) {
+                pool_->changed_.notify_all();
+            }
+        });
+    }
+    pool_->changed_.notify_one();
+}
+
+void TaskGroup::wait() {
+    if (!pool_) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(pool_->mutex_);
+    while (pending_ > 0) {
+        if (pool_->queue_.empty()) {
+            pool_->changed_.wait(lock);
+            continue;
+        }
+        auto task = std::move(pool_->queue_.back());
+        pool_->queue_.pop_back();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef MACDEPENDENCY_TASK_POOL_H
+#define MACDEPENDENCY_TASK_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Worker threads shared by tasks that may start tasks of their own, such as a
+// file whose slices are parsed concurrently. Tasks are queued with a
+// TaskGroup, and a thread waiting for its group runs queued tasks meanwhile,
+// so nesting neither deadlocks nor needs more threads.
+//
+// Idle workers take the oldest task, waiting threads the newest one, which
+// usually is one of the subtasks they are waiting for.
+class TaskPool {
+public:
+    // `jobs` threads in all: the thread that waits helps the jobs - 1 workers.
+    explicit TaskPool(unsigned jobs);
+    ~TaskPool();
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+
+private:
+    friend class TaskGroup;
+
+    void workerLoop();
+
+    std::mutex mutex_;
+    // Signalled when a task is queued, a group finishes or the pool stops
+    std::condition_variable changed_;
+    std::deque<std::function<void()>> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+// Tasks that are waited for together. Without a pool, or with a pool of one
+// job, run() runs the task right away.
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskPool *pool);
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    void run(std::function<void()> task);
+
+    // Returns once every task of the group finished, running queued tasks of
+    // any group until then.
+    void wait();
+
+private:
+    TaskPool *pool_;
+    size_t pending_ = 0;  // guarded by pool_->mutex_
+};
+
+#endif // MACDEPENDENCY_TASK_POOL_H
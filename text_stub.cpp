@@ -0,0 +1,662 @@
+#include "text_stub.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include <mach-o/arch.h>
+
+
+// What the stub says about one library, before it is split by architecture
+struct StubSection {
+    std::vector<std::string> archs;       // empty: every architecture of the stub
+    std::vector<std::string> symbols;     // defined and exported by the library itself
+    std::vector<std::string> libraries;   // re-exported libraries
+};
+
+struct StubDocument {
+    int version = 0;
+    std::vector<std::string> archs;
+    std::string platform;
+    std::string installName;
+    uint32_t currentVersion = 0x10000;         // TAPI's default of 1.0
+    uint32_t compatibilityVersion = 0x10000;
+    std::vector<StubSection> sections;
+};
+
+// A "key: value" line of the YAML subset TAPI writes. Flow lists ("[ a, b ]"),
+// which may span several lines, are split into `values`.
+struct YamlEntry {
+    size_t indent;
+    bool item;          // the line started a sequence item ("- key: value")
+    std::string key;
+    std::vector<std::string> values;
+};
+
+// A minimal JSON tree for v5 stubs
+struct JsonValue {
+    enum Type { Null, Boolean, Number, String, Array, Object } type = Null;
+    std::string text;   // String and Number
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue *get(const char *key) const;
+};
+
+static bool readYamlDocument(const std::string &text, std::vector<YamlEntry> &entries, std::string &tag);
+static bool parseYamlStub(const std::string &text, StubDocument &document, std::ostream &out);
+static bool parseJsonValue(const char *&pos, const char *end, JsonValue &value, int depth);
+static bool parseJsonStub(const std::string &text, StubDocument &document, std::ostream &out);
+static void addObjcSymbols(const std::string &kind, const std::vector<std::string> &names,
+                           const StubDocument &document, StubSection &section);
+static uint32_t parsePackedVersion(const std::string &text);
+static std::string archOfTarget(const std::string &target);
+
+
+// IMPLEMENTATION BELOW
+
+bool looksLikeTextStub(const char *data, size_t size) {
+    size_t i = 0;
+    while (i < size && std::isspace(static_cast<unsigned char>(data[i]))) {
+        i++;
+    }
+    return (i < size && data[i] == '{') || (size - i >= 3 && std::memcmp(data + i, "---", 3) == 0);
+}
+
+std::vector<MachOInfo> parseTextStub(const std::string &filename, std::ostream &out) {
+    std::ifstream file(filename, std::ios::binary | std::ios::in);
+    if (!file.is_open()) {
+        out << "Could not open file: " << filename << '\n';
+        return {};
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    StubDocument document;
+    auto first = text.find_first_not_of(" \t\r\n");
+    bool parsed = first != std::string::npos && text[first] == '{' ? parseJsonStub(text, document, out)
+                                                                    : parseYamlStub(text, document, out);
+    if (!parsed) {
+        out << "File " << filename << " is not a readable text stub\n";
+        return {};
+    }
+
+    std::vector<MachOInfo> result;
+    for (const auto &archName : document.archs) {
+        const auto arch = NXGetArchInfoFromName(archName.c_str());
+        if (!arch) {
+            out << "Unknown architecture in text stub: " << archName << '\n';
+            continue;
+        }
+        // Targets such as x86_64-macos and x86_64-maccatalyst share an architecture
+        if (std::any_of(result.begin(), result.end(), [&](const MachOInfo &info) { return info.arch == archName; })) {
+            continue;
+        }
+        MachOInfo info;
+        info.arch = archName;
+        info.cputype = arch->cputype;
+        info.cpusubtype = arch->cpusubtype;
+        info.filetype = MH_DYLIB;
+        info.is_64_bit = (arch->cputype & CPU_ARCH_ABI64) != 0;
+        info.text_stub = true;
+        info.dylib_id = document.installName;
+        info.current_version = document.currentVersion;
+        info.compatibility_version = document.compatibilityVersion;
+        for (const auto &section : document.sections) {
+            if (!section.archs.empty()
+                && std::find(section.archs.begin(), section.archs.end(), archName) == section.archs.end()) {
+                continue;
+            }
+            info.exports.insert(info.exports.end(), section.symbols.begin(), section.symbols.end());
+            for (const auto &library : section.libraries) {
+                info.deps.push_back({library, LC_REEXPORT_DYLIB, 0, 0});
+            }
+        }
+        result.push_back(std::move(info));
+    }
+    return result;
+}
+
+// Removes YAML quoting from a scalar: 'it''s' and "a\"b"
+static std::string unquote(std::string value) {
+    if (value.size() >= 2 && value.front() == '\'' && value.back() == '\'') {
+        std::string result;
+        for (size_t i = 1; i + 1 < value.size(); i++) {
+            result += value[i];
+            if (value[i] == '\'' && value[i + 1] == '\'') {
+                i++;
+            }
+        }
+        return result;
+    }
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        std::string result;
+        for (size_t i = 1; i + 1 < value.size(); i++) {
+            if (value[i] == '\\' && i + 2 < value.size()) {
+                i++;
+            }
+            result += value[i];
+        }
+        return result;
+    }
+    return value;
+}
+
+static std::string trim(const std::string &text) {
+    auto start = text.find_first_not_of(" \t\r");
+    if (start == std::string::npos) {
+        return {};
+    }
+    auto end = text.find_last_not_of(" \t\r");
+    return text.substr(start, end - start + 1);
+}
+
+// Splits "[ a, 'b, c', d ]" at the commas outside quotes
+static std::vector<std::string> splitFlowList(const std::string &list) {
+    std::vector<std::string> items;
+    std::string current;
+    char quote = 0;
+    for (size_t i = 1; i + 1 < list.size(); i++) {
+        char c = list[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == ',') {
+            if (!trim(current).empty()) {
+                items.push_back(unquote(trim(current)));
+            }
+            current.clear();
+            continue;
+        }
+        current += c;
+    }
+    if (!trim(current).empty()) {
+        items.push_back(unquote(trim(current)));
+    }
+    return items;
+}
+
+// Bracket depth of a flow list so far, ignoring brackets inside quotes
+static int bracketBalance(const std::string &text) {
+    int depth = 0;
+    char quote = 0;
+    for (char c : text) {
+        if (quote) {
+            quote = c == quote ? 0 : quote;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '[') {
+            depth++;
+        } else if (c == ']') {
+            depth--;
+        }
+    }
+    return depth;
+}
+
+static bool readYamlDocument(const std::string &text, std::vector<YamlEntry> &entries, std::string &tag) {
+    std::istringstream lines(text);
+    std::string line;
+    bool started = false;
+    while (std::getline(lines, line)) {
+        if (!started) {
+            if (trim(line).empty() || trim(line)[0] == '#') {
+                continue;
+            }
+            if (line.compare(0, 3, "---") != 0) {
+                return false;
+            }
+            tag = trim(line.substr(3));
+            started = true;
+            continue;
+        }
+        // Only the first document: later ones describe libraries inlined into an umbrella.
+        if (line.compare(0, 3, "...") == 0 || line.compare(0, 3, "---") == 0) {
+            break;
+        }
+        auto content = trim(line);
+        if (content.empty() || content[0] == '#') {
+            continue;
+        }
+
+        YamlEntry entry {line.find_first_not_of(' '), false, {}, {}};
+        if (content.compare(0, 2, "- ") == 0 || content == "-") {
+            entry.item = true;
+            entry.indent += 2;
+            content = trim(content.substr(1));
+        }
+        // Keys never contain ": ", symbol names only do inside quotes or lists
+        std::string value = content;
+        if (content[0] != '[' && content[0] != '\'' && content[0] != '"') {
+            auto colon = content.find(": ");
+            if (colon == std::string::npos && content.back() == ':') {
+                colon = content.size() - 1;
+            }
+            if (colon != std::string::npos) {
+                entry.key = trim(content.substr(0, colon));
+                value = trim(content.substr(colon + 1));
+            }
+        }
+        if (!value.empty() && value[0] == '[') {
+            while (bracketBalance(value) > 0 && std::getline(lines, line)) {
+                value += ' ' + trim(line);
+            }
+            entry.values = splitFlowList(value);
+        } else if (!value.empty()) {
+            entry.values.push_back(unquote(value));
+        }
+
+        // "- scalar" lines continue a block list of the previous key
+        if (entry.key.empty() && entry.item && !entries.empty()) {
+            auto &previous = entries.back();
+            previous.values.insert(previous.values.end(), entry.values.begin(), entry.values.end());
+            continue;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return started;
+}
+
+static bool parseYamlStub(const std::string &text, StubDocument &document, std::ostream &out) {
+    std::vector<YamlEntry> entries;
+    std::string tag;
+    if (!readYamlDocument(text, entries, tag)) {
+        return false;
+    }
+    if (tag == "!tapi-tbd-v2") {
+        document.version = 2;
+    } else if (tag == "!tapi-tbd-v3") {
+        document.version = 3;
+    } else if (tag == "!tapi-tbd") {
+        document.version = 4;  // confirmed by tbd-version below
+    } else if (tag.empty()) {
+        document.version = 1;
+    } else {
+        out << "Unsupported text stub " << tag << '\n';
+        return false;
+    }
+
+    enum { Other, Exports, ReexportedLibraries } list = Other;
+    for (const auto &entry : entries) {
+        const auto &values = entry.values;
+        auto value = values.empty() ? std::string() : values.front();
+        if (entry.indent == 0) {
+            list = Other;
+            if (entry.key == "tbd-version") {
+                document.version = std::atoi(value.c_str());
+            } else if (entry.key == "archs") {
+                document.archs = values;
+            } else if (entry.key == "targets") {
+                for (const auto &target : values) {
+                    document.archs.push_back(archOfTarget(target));
+                }
+                if (!values.empty()) {
+                    auto dash = values.front().find('-');
+                    document.platform = dash == std::string::npos ? "" : values.front().substr(dash + 1);
+                }
+            } else if (entry.key == "platform") {
+                document.platform = value;
+            } else if (entry.key == "install-name") {
+                document.installName = value;
+            } else if (entry.key == "current-version") {
+                document.currentVersion = parsePackedVersion(value);
+            } else if (entry.key == "compatibility-version") {
+                document.compatibilityVersion = parsePackedVersion(value);
+            } else if (entry.key == "exports") {
+                list = Exports;
+            } else if (entry.key == "reexported-libraries") {
+                list = ReexportedLibraries;
+            }
+            // "reexports" (v4) lists symbols defined elsewhere and is skipped
+            // like re-exports in an export trie, as are "undefineds".
+            continue;
+        }
+        if (list == Other) {
+            continue;
+        }
+        if (entry.item || document.sections.empty()) {
+            document.sections.emplace_back();
+        }
+        auto &section = document.sections.back();
+        if (entry.key == "archs") {
+            section.archs = values;
+        } else if (entry.key == "targets") {
+            for (const auto &target : values) {
+                section.archs.push_back(archOfTarget(target));
+            }
+        } else if (list == ReexportedLibraries) {
+            if (entry.key == "libraries") {
+                section.libraries.insert(section.libraries.end(), values.begin(), values.end());
+            }
+        } else if (entry.key == "symbols" || entry.key == "weak-def-symbols" || entry.key == "weak-symbols"
+                   || entry.key == "thread-local-symbols") {
+            section.symbols.insert(section.symbols.end(), values.begin(), values.end());
+        } else if (entry.key == "re-exports") {
+            section.libraries.insert(section.libraries.end(), values.begin(), values.end());
+        } else if (entry.key == "objc-classes" || entry.key == "objc-eh-types" || entry.key == "objc-ivars") {
+            addObjcSymbols(entry.key.substr(5), values, document, section);
+        }
+    }
+    if (document.archs.empty() || document.installName.empty()) {
+        out << "Text stub without architectures or install name\n";
+        return false;
+    }
+    return true;
+}
+
+const JsonValue *JsonValue::get(const char *key) const {
+    for (const auto &member : members) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+static void skipJsonSpace(const char *&pos, const char *end) {
+    while (pos < end && std::isspace(static_cast<unsigned char>(*pos))) {
+        pos++;
+    }
+}
+
+static bool parseJsonString(const char *&pos, const char *end, std::string &text) {
+    if (pos >= end || *pos != '"') {
+        return false;
+    }
+    for (pos++; pos < end && *pos != '"'; pos++) {
+        if (*pos != '\\') {
+            text += *pos;
+            continue;
+        }
+        if (++pos >= end) {
+            return false;
+        }
+        switch (*pos) {
+            case 'n': text += '\n'; break;
+            case 't': text += '\t'; break;
+            case 'r': text += '\r'; break;
+            case 'b': text += '\b'; break;
+            case 'f': text += '\f'; break;
+            case 'u':
+            {
+                // Symbol names are ASCII; anything else is kept as UTF-8 of the code unit.
+                if (end - pos < 5) {
+                    return false;
+                }
+                auto code = static_cast<unsigned>(std::strtoul(std::string(pos + 1, 4).c_str(), nullptr, 16));
+                if (code < 0x80) {
+                    text += static_cast<char>(code);
+                } else if (code < 0x800) {
+                    text += static_cast<char>(0xc0 | (code >> 6));
+                    text += static_cast<char>(0x80 | (code & 0x3f));
+                } else {
+                    text += static_cast<char>(0xe0 | (code >> 12));
+                    text += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                    text += static_cast<char>(0x80 | (code & 0x3f));
+                }
+                pos += 4;
+            }
+                break;
+            default:
+                text += *pos;  // \" \\ \/
+                break;
+        }
+    }
+    if (pos >= end) {
+        return false;
+    }
+    pos++;
+    return true;
+}
+
+static bool parseJsonValue(const char *&pos, const char *end, JsonValue &value, int depth) {
+    if (depth > 64) {
+        return false;
+    }
+    skipJsonSpace(pos, end);
+    if (pos >= end) {
+        return false;
+    }
+    switch (*pos) {
+        case '{':
+            value.type = JsonValue::Object;
+            pos++;
+            skipJsonSpace(pos, end);
+            if (pos < end && *pos == '}') {
+                pos++;
+                return true;
+            }
+            while (true) {
+                std::pair<std::string, JsonValue> member;
+                skipJsonSpace(pos, end);
+                if (!parseJsonString(pos, end, member.first)) {
+                    return false;
+                }
+                skipJsonSpace(pos, end);
+                if (pos >= end || *pos++ != ':' || !parseJsonValue(pos, end, member.second, depth + 1)) {
+                    return false;
+                }
+                value.members.push_back(std::move(member));
+                skipJsonSpace(pos, end);
+                if (pos < end && *pos == ',') {
+                    pos++;
+                } else if (pos < end && *pos == '}') {
+                    pos++;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        case '[':
+            value.type = JsonValue::Array;
+            pos++;
+            skipJsonSpace(pos, end);
+            if (pos < end && *pos == ']') {
+                pos++;
+                return true;
+            }
+            while (true) {
+                value.items.emplace_back();
+                if (!parseJsonValue(pos, end, value.items.back(), depth + 1)) {
+                    return false;
+                }
+                skipJsonSpace(pos, end);
+                if (pos < end && *pos == ',') {
+                    pos++;
+                } else if (pos < end && *pos == ']') {
+                    pos++;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        case '"':
+            value.type = JsonValue::String;
+            return parseJsonString(pos, end, value.text);
+        default:
+        {
+            auto start = pos;
+            while (pos < end && (std::isalnum(static_cast<unsigned char>(*pos)) || std::strchr("+-.", *pos))) {
+                pos++;
+            }
+            value.text.assign(start, pos);
+            if (value.text == "true" || value.text == "false") {
+                value.type = JsonValue::Boolean;
+            } else if (value.text == "null") {
+                value.type = JsonValue::Null;
+            } else if (!value.text.empty() && (std::isdigit(static_cast<unsigned char>(value.text[0]))
+                                               || value.text[0] == '-')) {
+                value.type = JsonValue::Number;
+            } else {
+                return false;
+            }
+            return true;
+        }
+    }
+}
+
+// Strings of `key` in every element of an array of objects, e.g.
+// "install_names": [{"name": "/usr/lib/libz.1.dylib"}]
+static std::vector<std::string> jsonStrings(const JsonValue *array, const char *key) {
+    std::vector<std::string> result;
+    if (!array) {
+        return result;
+    }
+    for (const auto &item : array->items) {
+        auto field = item.get(key);
+        if (field && (field->type == JsonValue::String || field->type == JsonValue::Number)) {
+            result.push_back(field->text);
+        } else if (field && field->type == JsonValue::Array) {
+            for (const auto &element : field->items) {
+                result.push_back(element.text);
+            }
+        }
+    }
+    return result;
+}
+
+static std::vector<std::string> jsonArchs(const JsonValue &item) {
+    std::vector<std::string> archs;
+    if (auto targets = item.get("targets")) {
+        for (const auto &target : targets->items) {
+            archs.push_back(archOfTarget(target.text));
+        }
+    }
+    return archs;
+}
+
+static bool parseJsonStub(const std::string &text, StubDocument &document, std::ostream &out) {
+    JsonValue root;
+    const char *pos = text.data();
+    if (!parseJsonValue(pos, text.data() + text.size(), root, 0) || root.type != JsonValue::Object) {
+        return false;
+    }
+    auto version = root.get("tapi_tbd_version");
+    document.version = version ? std::atoi(version->text.c_str()) : 0;
+    if (document.version != 5) {
+        out << "Unsupported text stub version " << document.version << '\n';
+        return false;
+    }
+    auto library = root.get("main_library");
+    if (!library) {
+        return false;
+    }
+
+    auto targets = jsonStrings(library->get("target_info"), "target");
+    for (const auto &target : targets) {
+        document.archs.push_back(archOfTarget(target));
+    }
+    if (!targets.empty()) {
+        auto dash = targets.front().find('-');
+        document.platform = dash == std::string::npos ? "" : targets.front().substr(dash + 1);
+    }
+    auto installNames = jsonStrings(library->get("install_names"), "name");
+    if (!installNames.empty()) {
+        document.installName = installNames.front();
+    }
+    auto currentVersions = jsonStrings(library->get("current_versions"), "version");
+    if (!currentVersions.empty()) {
+        document.currentVersion = parsePackedVersion(currentVersions.front());
+    }
+    auto compatibilityVersions = jsonStrings(library->get("compatibility_versions"), "version");
+    if (!compatibilityVersions.empty()) {
+        document.compatibilityVersion = parsePackedVersion(compatibilityVersions.front());
+    }
+
+    if (auto reexported = library->get("reexported_libraries")) {
+        for (const auto &item : reexported->items) {
+            StubSection section;
+            section.archs = jsonArchs(item);
+            if (auto names = item.get("names")) {
+                for (const auto &name : names->items) {
+                    section.libraries.push_back(name.text);
+                }
+            }
+            document.sections.push_back(std::move(section));
+        }
+    }
+    // "reexported_symbols" are defined elsewhere and skipped, as in parseYamlStub()
+    if (auto exported = library->get("exported_symbols")) {
+        for (const auto &item : exported->items) {
+            StubSection section;
+            section.archs = jsonArchs(item);
+            for (auto kind : {"data", "text"}) {
+                auto symbols = item.get(kind);
+                if (!symbols) {
+                    continue;
+                }
+                for (const auto &member : symbols->members) {
+                    std::vector<std::string> names;
+                    for (const auto &name : member.second.items) {
+                        names.push_back(name.text);
+                    }
+                    if (member.first == "objc_class" || member.first == "objc_eh_type" || member.first == "objc_ivar") {
+                        addObjcSymbols(member.first.substr(5), names, document, section);
+                    } else {
+                        section.symbols.insert(section.symbols.end(), names.begin(), names.end());
+                    }
+                }
+            }
+            document.sections.push_back(std::move(section));
+        }
+    }
+    if (document.archs.empty() || document.installName.empty()) {
+        out << "Text stub without architectures or install name\n";
+        return false;
+    }
+    return true;
+}
+
+// Stubs list Objective-C classes by name; the symbols are what the linker would
+// see. `kind` is "classes"/"class", "eh-types"/"eh_type" or "ivars"/"ivar".
+static void addObjcSymbols(const std::string &kind, const std::vector<std::string> &names,
+                           const StubDocument &document, StubSection &section) {
+    bool legacyRuntime = document.platform == "macosx" || document.platform == "macos";
+    for (auto name : names) {
+        // v1 and v2 stubs keep the C underscore on class names
+        if (document.version < 3 && !name.empty() && name[0] == '_') {
+            name.erase(0, 1);
+        }
+        if (kind[0] == 'c') {
+            bool i386Only = legacyRuntime && section.archs.size() == 1 && section.archs[0] == "i386";
+            if (i386Only) {
+                section.symbols.push_back(".objc_class_name_" + name);
+            } else {
+                section.symbols.push_back("_OBJC_CLASS_$_" + name);
+                section.symbols.push_back("_OBJC_METACLASS_$_" + name);
+            }
+        } else if (kind[0] == 'e') {
+            section.symbols.push_back("_OBJC_EHTYPE_$_" + name);
+        } else {
+            section.symbols.push_back("_OBJC_IVAR_$_" + name);
+        }
+    }
+}
+
+// "1.2.3" as in LC_ID_DYLIB: xxxx.yy.zz
+static uint32_t parsePackedVersion(const std::string &text) {
+    uint32_t parts[3] = {0, 0, 0};
+    size_t part = 0;
+    for (char c : text) {
+        if (c == '.') {
+            if (++part == 3) {
+                break;
+            }
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            parts[part] = parts[part] * 10 + static_cast<uint32_t>(c - '0');
+        }
+    }
+    return (std::min<uint32_t>(parts[0], 0xffff) << 16) | (std::min<uint32_t>(parts[1], 0xff) << 8)
+           | std::min<uint32_t>(parts[2], 0xff);
+}
+
+// "arm64e-ios-simulator" -> "arm64e"
+static std::string archOfTarget(const std::string &target) {
+    return target.substr(0, target.find('-'));
+}
@@ -0,0 +1,27 @@
+#ifndef MACDEPENDENCY_TEXT_STUB_H
+#define MACDEPENDENCY_TEXT_STUB_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "macho_parser.h"
+
+
+// True if the data starts like a TAPI text stub: a YAML document ("---") or,
+// for version 5, a JSON object.
+bool looksLikeTextStub(const char *data, size_t size);
+
+// Parses the main library of a .tbd text stub, as found in Apple SDKs in place
+// of the dylibs themselves. Handles the subset of TAPI v1-v4 (YAML) and v5
+// (JSON) that dependency resolution needs.
+//
+// The result has one MachOInfo per architecture the stub lists, with
+// text_stub set: the install name, versions and re-exported libraries end up
+// where LC_ID_DYLIB and LC_REEXPORT_DYLIB would put them, and the exported
+// symbols in `exports`. Problems are reported to `out`; an unreadable stub
+// gives an empty result.
+std::vector<MachOInfo> parseTextStub(const std::string &filename, std::ostream &out);
+
+#endif // MACDEPENDENCY_TEXT_STUB_H